@@ -0,0 +1,159 @@
+"""Checks incremental propagation against full propagation.
+
+Builds a small random AS graph, then compares the get_rib_columns() output
+of an engine updated in place with that of a freshly set up engine, for
+run(1) after run(0), update_policies() from BGP to ROV and back, and
+withdraw() followed by a fresh run. Also checks that delta propagation
+leaves no RIB change log behind and has nothing to send in a second run.
+
+    python scripts/test_incremental.py
+"""
+import os
+import random
+import tempfile
+
+import numpy as np
+
+import python_example
+
+NUM_ASES = 60
+NUM_PREFIXES = 12
+SEED = 7
+
+
+def write_graph(path, rng):
+    # AS i only buys transit from ASes with a lower index, so the graph has
+    # no provider cycles and ranks can be computed from the highest index down
+    asns = list(range(1, NUM_ASES + 1))
+    providers = {asn: set() for asn in asns}
+    customers = {asn: set() for asn in asns}
+    peers = {asn: set() for asn in asns}
+    for asn in asns[3:]:
+        for provider in rng.sample(asns[:asn - 1], rng.randint(1, min(3, asn - 1))):
+            providers[asn].add(provider)
+            customers[provider].add(asn)
+    for _ in range(NUM_ASES):
+        a, b = rng.sample(asns, 2)
+        if b not in providers[a] and b not in customers[a]:
+            peers[a].add(b)
+            peers[b].add(a)
+
+    ranks = {}
+    for asn in reversed(asns):
+        ranks[asn] = 1 + max((ranks[c] for c in customers[asn]), default=-1)
+
+    def asn_list(values):
+        return "{" + ",".join(str(v) for v in sorted(values)) + "}"
+
+    with open(path, "w") as f:
+        f.write("asn\tpeers\tcustomers\tproviders\tinput_clique\tixp\tcustomer_cone_size\t"
+                "propagation_rank\tstubs\tstub\tmultihomed\ttransit\n")
+        for asn in asns:
+            f.write("\t".join([
+                str(asn), asn_list(peers[asn]), asn_list(customers[asn]), asn_list(providers[asn]),
+                str(asn <= 3), "False", str(len(customers[asn])), str(ranks[asn]), "{}",
+                str(not customers[asn]), str(len(providers[asn]) > 1), str(bool(customers[asn])),
+            ]) + "\n")
+    return asns
+
+
+def write_announcements(path, asns, rng):
+    # Every prefix has a legitimate origin covered by a ROA, and some also
+    # have a hijacker the ROA makes invalid. Hijacks come after the
+    # legitimate row so withdrawing them keeps the prefix IDs
+    hijacks = []
+    with open(path, "w") as f:
+        f.write("prefix\tas_path\ttimestamp\tseed_asn\troa_valid_length\troa_origin\t"
+                "recv_relationship\twithdraw\ttraceback_end\tcommunities\n")
+        for i in range(NUM_PREFIXES):
+            prefix = f"10.{i}.0.0/16"
+            origin, hijacker = rng.sample(asns, 2)
+            f.write(f"{prefix}\t{{{origin}}}\t0\t{origin}\tTrue\t{origin}\t0\tFalse\tTrue\t()\n")
+            if i % 2 == 0:
+                f.write(f"{prefix}\t{{{hijacker}}}\t1\t{hijacker}\tTrue\t{origin}\t0\tFalse\tTrue\t()\n")
+                hijacks.append((hijacker, prefix))
+    return hijacks
+
+
+def full_run(graph_path, announcements, non_default_asn_cls_str_dict, lazy_stubs, num_threads):
+    engine = python_example.get_engine(graph_path)
+    engine.verbose = False
+    engine.lazy_stubs = lazy_stubs
+    engine.setup(announcements, "BGPSimplePolicy", non_default_asn_cls_str_dict)
+    engine.run(0, num_threads)
+    return engine.get_rib_columns(num_threads=num_threads)
+
+
+def assert_same(columns, expected, what):
+    for name, column in expected.items():
+        assert np.array_equal(columns[name], column), f"{what}: {name} differs from a full run"
+
+
+def check(graph_path, anns_path, asns, hijacks, lazy_stubs, num_threads):
+    announcements = python_example.read_announcements(anns_path)
+    rov_asns = {asn: "ROVSimplePolicy" for asn in asns[::3]}
+    bgp_asns = {asn: "BGPSimplePolicy" for asn in rov_asns}
+    expected = full_run(graph_path, announcements, {}, lazy_stubs, num_threads)
+    expected_rov = full_run(graph_path, announcements, rov_asns, lazy_stubs, num_threads)
+
+    engine = python_example.get_engine(graph_path)
+    engine.verbose = False
+    engine.lazy_stubs = lazy_stubs
+    engine.setup(announcements)
+    engine.run(0, num_threads)
+    assert_same(engine.get_rib_columns(num_threads=num_threads), expected, "run(0)")
+    # A converged engine has nothing new to send in the next round
+    engine.run(1, num_threads)
+    assert_same(engine.get_rib_columns(num_threads=num_threads), expected, "run(1) after run(0)")
+
+    engine.update_policies(rov_asns)
+    assert_same(engine.get_rib_columns(num_threads=num_threads), expected_rov, "update_policies to ROV")
+    engine.update_policies(bgp_asns)
+    assert_same(engine.get_rib_columns(num_threads=num_threads), expected, "update_policies back to BGP")
+
+    # Routes left after withdrawing the hijacks match a run that never had them
+    withdrawn = set(hijacks)
+    kept = [ann for ann in announcements.to_list() if (ann.seed_asn, ann.prefix) not in withdrawn]
+    engine.withdraw(hijacks)
+    assert_same(engine.get_rib_columns(num_threads=num_threads),
+                full_run(graph_path, kept, {}, lazy_stubs, num_threads), "withdraw")
+
+    engine.reset()
+    engine.setup(announcements)
+    engine.run(0, num_threads)
+    assert_same(engine.get_rib_columns(num_threads=num_threads), expected, "fresh run after withdraw")
+
+
+def check_delta_propagation(graph_path, anns_path, num_threads):
+    announcements = python_example.read_announcements(anns_path)
+    for mode in (python_example.PropagationMode.RANK_PARALLEL, python_example.PropagationMode.PREFIX_SHARDED):
+        engine = python_example.get_engine(graph_path)
+        engine.verbose = False
+        engine.setup(announcements)
+        engine.run(0, num_threads, mode)
+        expected = engine.get_rib_columns(num_threads=num_threads)
+        # Counted for the whole process; every other engine has converged too
+        assert engine.memory_report()["rib_changes"]["bytes"] == 0, f"{mode}: RIB change logs kept after run(0)"
+        engine.run(1, num_threads, mode)
+        assert engine.get_metrics()["anns_received"] == 0, f"{mode}: run(1) sent routes that were already sent"
+        assert_same(engine.get_rib_columns(num_threads=num_threads), expected, f"{mode}: run(1) after run(0)")
+
+
+def main():
+    rng = random.Random(SEED)
+    with tempfile.TemporaryDirectory() as tmp:
+        graph_path = os.path.join(tmp, "graph.tsv")
+        anns_path = os.path.join(tmp, "anns.tsv")
+        asns = write_graph(graph_path, rng)
+        hijacks = write_announcements(anns_path, asns, rng)
+        for lazy_stubs in (False, True):
+            for num_threads in (1, 4):
+                check(graph_path, anns_path, asns, hijacks, lazy_stubs, num_threads)
+                print(f"lazy_stubs={lazy_stubs} num_threads={num_threads}: incremental matches full")
+        for num_threads in (1, 4):
+            check_delta_propagation(graph_path, anns_path, num_threads)
+            print(f"num_threads={num_threads}: delta propagation sends nothing twice")
+
+
+if __name__ == "__main__":
+    main()
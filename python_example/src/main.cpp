@@ -1,5 +1,6 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
+#include <pybind11/numpy.h>
 //#include <pybind11/optional.h>
 
 
@@ -19,6 +20,24 @@
 #include <stdexcept> // for std::runtime_error
 #include <set>
 #include <type_traits>  // for std::is_base_of
+#include <unordered_map>
+#include <cstdint>
+#include <iterator>
+#include <numeric>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <charconv>
+#include <string_view>
+#include <cstring>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 
 // Disable threading since we don't use it
@@ -32,7 +51,7 @@
 //was with 100000000U times
 //#define BOOST_DISABLE_THREADS
 
-enum class Relationships {
+enum class Relationships : uint8_t {
     PROVIDERS = 1,
     PEERS = 2,
     CUSTOMERS = 3,
@@ -41,839 +60,4321 @@ enum class Relationships {
 };
 
 
-class Announcement {
-public:
-    const std::string prefix;
-    const std::vector<int> as_path;
-    const int timestamp;
-    const std::optional<int> seed_asn;
-    const std::optional<bool> roa_valid_length;
-    const std::optional<int> roa_origin;
-    const Relationships recv_relationship;
-    const bool withdraw;
-    const bool traceback_end;
-    const std::vector<std::string> communities;
+// What counted memory is used for; see CPPSimulationEngine::memory_report
+enum class MemoryCategory : uint8_t {
+    // Adjacency and per AS arrays of ASGraph
+    AS_GRAPH = 0,
+    // Interned prefix strings
+    PREFIXES = 1,
+    // Announcement objects and the columns of AnnouncementBatch
+    ANNOUNCEMENTS = 2,
+    // Interned community strings and the per row community lists
+    COMMUNITIES = 3,
+    // Policy objects, one per AS
+    POLICIES = 4,
+    LOCAL_RIBS = 5,
+    RECV_QUEUES = 6,
+    // Anns in the engine's announcement arena
+    ANNS = 7,
+    // Nodes of the AS path store
+    AS_PATHS = 8,
+    // Change logs of local RIBs; empty once a run or update converged
+    RIB_CHANGES = 9
+};
+constexpr size_t NUM_MEMORY_CATEGORIES = 10;
 
-    // Constructor
-    Announcement(const std::string& prefix, const std::vector<int>& as_path, int timestamp,
-                 const std::optional<int>& seed_asn, const std::optional<bool>& roa_valid_length,
-                 const std::optional<int>& roa_origin, Relationships recv_relationship,
-                 bool withdraw = false, bool traceback_end = false,
-                 const std::vector<std::string>& communities = {})
-        : prefix(prefix), as_path(as_path), timestamp(timestamp),
-          seed_asn(seed_asn), roa_valid_length(roa_valid_length), roa_origin(roa_origin),
-          recv_relationship(recv_relationship), withdraw(withdraw),
-          traceback_end(traceback_end), communities(communities) {}
+inline const char* memory_category_name(MemoryCategory category) {
+    static const char* const names[NUM_MEMORY_CATEGORIES] = {
+        "as_graph", "prefixes", "announcements", "communities", "policies",
+        "local_ribs", "recv_queues", "anns", "as_paths", "rib_changes"
+    };
+    return names[static_cast<size_t>(category)];
+}
 
-    // Methods
-    bool prefix_path_attributes_eq(const Announcement* ann) const {
-        if (!ann) {
-            return false;
-        }
-        return ann->prefix == this->prefix && ann->as_path == this->as_path;
+
+// Live bytes, live objects and peak bytes of every MemoryCategory, for the
+// whole process. Kept exactly by CountingAllocator and the arenas on every
+// allocation and free. Peaks can be restarted to measure one phase
+class MemoryCounters {
+public:
+    struct Usage {
+        int64_t bytes;
+        int64_t objects;
+        int64_t peak_bytes;
+    };
+
+    static void allocated(MemoryCategory category, size_t bytes, size_t objects) {
+        add(counter(static_cast<size_t>(category)), static_cast<int64_t>(bytes), static_cast<int64_t>(objects));
+        add(counter(NUM_MEMORY_CATEGORIES), static_cast<int64_t>(bytes), static_cast<int64_t>(objects));
     }
 
-    bool invalid_by_roa() const {
-        if (!roa_origin.has_value()) {
-            return false;
-        }
-        return origin() != roa_origin.value() || !roa_valid_length.value();
+    static void deallocated(MemoryCategory category, size_t bytes, size_t objects) {
+        add(counter(static_cast<size_t>(category)), -static_cast<int64_t>(bytes), -static_cast<int64_t>(objects));
+        add(counter(NUM_MEMORY_CATEGORIES), -static_cast<int64_t>(bytes), -static_cast<int64_t>(objects));
     }
 
-    bool valid_by_roa() const {
-        return roa_origin.has_value() && origin() == roa_origin.value() && roa_valid_length.value();
+    static Usage usage(MemoryCategory category) {
+        return usage(counter(static_cast<size_t>(category)));
     }
 
-    bool unknown_by_roa() const {
-        return !invalid_by_roa() && !valid_by_roa();
+    static Usage total_usage() {
+        return usage(counter(NUM_MEMORY_CATEGORIES));
     }
 
-    bool covered_by_roa() const {
-        return !unknown_by_roa();
+    static void restart_peaks() {
+        // Peaks from here on start at what is live now
+        for (size_t i = 0; i <= NUM_MEMORY_CATEGORIES; ++i) {
+            counter(i).peak_bytes.store(counter(i).bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
     }
 
-    bool roa_routed() const {
-        return roa_origin.has_value() && roa_origin.value() != 0;
+private:
+    struct alignas(64) Counter {
+        std::atomic<int64_t> bytes{0};
+        std::atomic<int64_t> objects{0};
+        std::atomic<int64_t> peak_bytes{0};
+    };
+
+    static Counter& counter(size_t index) {
+        // One per category, then the total
+        static Counter counters[NUM_MEMORY_CATEGORIES + 1];
+        return counters[index];
     }
 
-    int origin() const {
-        if (!as_path.empty()) {
-            return as_path.back();
+    static void add(Counter& counter, int64_t bytes, int64_t objects) {
+        int64_t live = counter.bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        counter.objects.fetch_add(objects, std::memory_order_relaxed);
+        int64_t peak = counter.peak_bytes.load(std::memory_order_relaxed);
+        while (live > peak && !counter.peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
         }
-        return -1; // Or another appropriate default value
     }
-};
 
+    static Usage usage(const Counter& counter) {
+        return {counter.bytes.load(std::memory_order_relaxed), counter.objects.load(std::memory_order_relaxed),
+                counter.peak_bytes.load(std::memory_order_relaxed)};
+    }
+};
 
-class LocalRIB {
-protected:
-    std::map<std::string, std::shared_ptr<Announcement>> _info;
 
+// Keeps the highest bytes of every category seen while it is alive in
+// peak_bytes[phase], across every time the phase is run. Peaks are process
+// wide, so concurrent phases see each other's allocations
+class MemoryPhase {
 public:
-    LocalRIB() {}
+    using PeakBytes = std::map<std::string, std::map<std::string, int64_t>>;
 
-    std::shared_ptr<Announcement> get_ann(const std::string& prefix, const std::shared_ptr<Announcement>& default_ann = nullptr) const {
-        // Returns announcement or nullptr from the local rib by prefix
-        auto it = _info.find(prefix);
-        if (it != _info.end()) {
-            return it->second;
+    MemoryPhase(PeakBytes& peak_bytes, const char* phase, bool enabled = true)
+        : _peak_bytes(peak_bytes), _phase(phase), _enabled(enabled) {
+        if (_enabled) {
+            MemoryCounters::restart_peaks();
         }
-        return default_ann;
     }
 
-    void add_ann(const std::shared_ptr<Announcement>& ann) {
-        // Adds an announcement to local rib with prefix as key
-        _info[ann->prefix] = ann;
+    ~MemoryPhase() {
+        if (!_enabled) {
+            return;
+        }
+        auto& peaks = _peak_bytes[_phase];
+        auto record = [&](const char* name, int64_t bytes) {
+            int64_t& peak = peaks[name];
+            peak = std::max(peak, bytes);
+        };
+        for (size_t i = 0; i < NUM_MEMORY_CATEGORIES; ++i) {
+            auto category = static_cast<MemoryCategory>(i);
+            record(memory_category_name(category), MemoryCounters::usage(category).peak_bytes);
+        }
+        record("total", MemoryCounters::total_usage().peak_bytes);
     }
 
-    void remove_ann(const std::string& prefix) {
-        // Removes announcement from local rib based on prefix
-        _info.erase(prefix);
+    MemoryPhase(const MemoryPhase&) = delete;
+    MemoryPhase& operator=(const MemoryPhase&) = delete;
+
+private:
+    PeakBytes& _peak_bytes;
+    const char* _phase;
+    bool _enabled;
+};
+
+
+// std::allocator that reports what it allocates to MemoryCounters under
+// Category. Objects are counted per element slot, so a vector counts its
+// capacity. Heap buffers owned by the elements, such as long strings, are
+// not counted
+template <typename T, MemoryCategory Category>
+class CountingAllocator {
+public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = CountingAllocator<U, Category>;
+    };
+
+    CountingAllocator() noexcept = default;
+
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U, Category>&) noexcept {}
+
+    T* allocate(size_t n) {
+        T* pointer = std::allocator<T>().allocate(n);
+        MemoryCounters::allocated(Category, n * sizeof(T), n);
+        return pointer;
     }
 
-    const std::map<std::string, std::shared_ptr<Announcement>>& prefix_anns() const {
-        // Returns all prefixes and announcements zipped
-        return _info;
+    void deallocate(T* pointer, size_t n) noexcept {
+        MemoryCounters::deallocated(Category, n * sizeof(T), n);
+        std::allocator<T>().deallocate(pointer, n);
     }
+
+    template <typename U>
+    bool operator==(const CountingAllocator<U, Category>&) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const CountingAllocator<U, Category>&) const noexcept { return false; }
 };
 
+template <typename T, MemoryCategory Category>
+using CountedVector = std::vector<T, CountingAllocator<T, Category>>;
 
-class RecvQueue {
+
+// Sentinel for announcements whose prefix has not been interned by an engine yet
+constexpr uint32_t NO_PREFIX_ID = UINT32_MAX;
+
+
+// Dense IDs for strings. Prefixes and communities each have their own
+// memory category
+template <MemoryCategory Category>
+class InternTable {
 protected:
-    std::map<std::string, std::vector<std::shared_ptr<Announcement>>> _info;
+    CountedVector<std::string, Category> _prefixes;
+    std::unordered_map<std::string, uint32_t, std::hash<std::string>, std::equal_to<std::string>,
+                       CountingAllocator<std::pair<const std::string, uint32_t>, Category>> _ids;
 
 public:
-    RecvQueue() {}
+    InternTable() {}
 
-    void add_ann(const std::shared_ptr<Announcement>& ann) {
-        // Appends ann to the list of received announcements for that prefix
-        _info[ann->prefix].push_back(ann);
+    uint32_t intern(const std::string& prefix) {
+        // Returns the dense ID for the prefix, assigning the next one if it is new
+        auto it = _ids.find(prefix);
+        if (it != _ids.end()) {
+            return it->second;
+        }
+        uint32_t prefix_id = static_cast<uint32_t>(_prefixes.size());
+        _prefixes.push_back(prefix);
+        _ids.emplace(prefix, prefix_id);
+        return prefix_id;
     }
 
-    const std::map<std::string, std::vector<std::shared_ptr<Announcement>>>& prefix_anns() const {
-        // Returns all prefixes and announcement lists
-        return _info;
+    std::optional<uint32_t> get_id(const std::string& prefix) const {
+        // Returns the ID of an already interned prefix
+        auto it = _ids.find(prefix);
+        if (it != _ids.end()) {
+            return it->second;
+        }
+        return std::nullopt;
     }
 
-    const std::vector<std::shared_ptr<Announcement>>& get_ann_list(const std::string& prefix) const {
-        // Returns received announcement list for a given prefix
-        static const std::vector<std::shared_ptr<Announcement>> empty; // To return in case of no match
-        auto it = _info.find(prefix);
-        if (it != _info.end()) {
-            return it->second;
+    const std::string& get_prefix(uint32_t prefix_id) const {
+        // Materializes the prefix string for an ID (Python/export boundary only)
+        if (prefix_id >= _prefixes.size()) {
+            throw std::runtime_error("Prefix ID not in prefix table: " + std::to_string(prefix_id));
         }
-        return empty;
+        return _prefixes[prefix_id];
     }
-};
 
+    size_t size() const {
+        return _prefixes.size();
+    }
 
+    void clear() {
+        _prefixes.clear();
+        _ids.clear();
+    }
+};
 
-class AS; // Forward declaration
+using PrefixTable = InternTable<MemoryCategory::PREFIXES>;
+using CommunityTable = InternTable<MemoryCategory::COMMUNITIES>;
 
-class Policy {
-public:
-    std::weak_ptr<AS> as;
-    LocalRIB localRIB;
-    RecvQueue recvQueue;
 
-    Policy() {}
+// Index of the worker the current thread is doing engine work for: 0 for
+// the thread that called into the engine, 1..n-1 for ThreadPool workers.
+// Per-worker state such as arena cursors is looked up with it
+inline size_t& current_worker_slot() {
+    static thread_local size_t worker_slot = 0;
+    return worker_slot;
+}
 
-    virtual void receive_ann(const std::shared_ptr<Announcement>& ann) = 0;
-    virtual void process_incoming_anns(Relationships from_rel, int propagation_round, bool reset_q = true) = 0;
-    virtual void propagate_to_providers() = 0;
-    virtual void propagate_to_customers() = 0;
-    virtual void propagate_to_peers() = 0;
 
-    // You need virtual destructors in base class or else derived classes
-    // won't clean up properly
-    virtual ~Policy() = default; // Virtual and uses the default implementation
+// Sets the current thread's worker slot for a scope
+class WorkerSlotGuard {
+public:
+    explicit WorkerSlotGuard(size_t worker_slot) : previous_slot(current_worker_slot()) {
+        current_worker_slot() = worker_slot;
+    }
+    ~WorkerSlotGuard() {
+        current_worker_slot() = previous_slot;
+    }
+    WorkerSlotGuard(const WorkerSlotGuard&) = delete;
+    WorkerSlotGuard& operator=(const WorkerSlotGuard&) = delete;
+private:
+    size_t previous_slot;
 };
 
 
-class BGPSimplePolicy : public Policy {
+// Fixed set of worker threads. parallel_for() is a barrier: it returns
+// once every index has been processed, and the calling thread helps out
+class ThreadPool {
 public:
-    BGPSimplePolicy() : Policy() {
-        std::cout<<"in bgpsimple"<<std::endl;
-        initialize_gao_rexford_functions();
-
-        std::cout<<"out bgpsimple"<<std::endl;
+    explicit ThreadPool(size_t num_threads)
+        : _num_threads(std::max<size_t>(num_threads, 1)), _job(nullptr), _job_size(0), _grain(1),
+          _next_index(0), _generation(0), _num_busy(0), _stopping(false) {
+        for (size_t worker_slot = 1; worker_slot < _num_threads; ++worker_slot) {
+            _workers.emplace_back([this, worker_slot]() { worker_loop(worker_slot); });
+        }
     }
-    // You need virtual destructors in base class or else derived classes
-    // won't clean up properly
-    virtual ~BGPSimplePolicy() override = default; // Virtual and uses the default implementation
-
-    void process_incoming_anns(Relationships from_rel, int propagation_round, bool reset_q = true) override;
-    void propagate_to_providers() override;
-    void propagate_to_customers() override;
-    void propagate_to_peers() override;
-    void receive_ann(const std::shared_ptr<Announcement>& ann) override;
-protected:
-    std::vector<std::function<std::shared_ptr<Announcement>(const std::shared_ptr<Announcement>&, const std::shared_ptr<Announcement>&)>> gao_rexford_functions;
 
-    bool valid_ann(const std::shared_ptr<Announcement>& ann, Relationships recv_relationship) const;
-    std::shared_ptr<Announcement> copy_and_process(const std::shared_ptr<Announcement>& ann, Relationships recv_relationship);
-    void reset_queue(bool reset_q);
-    /////////////////////////////////////////// gao rexford
-    virtual void initialize_gao_rexford_functions();
-    std::shared_ptr<Announcement> get_best_ann_by_gao_rexford(const std::shared_ptr<Announcement>& current_ann, const std::shared_ptr<Announcement>& new_ann);
-    std::shared_ptr<Announcement> get_best_ann_by_local_pref(const std::shared_ptr<Announcement>& current_ann, const std::shared_ptr<Announcement>& new_ann);
-    std::shared_ptr<Announcement> get_best_ann_by_as_path(const std::shared_ptr<Announcement>& current_ann, const std::shared_ptr<Announcement>& new_ann);
-    std::shared_ptr<Announcement> get_best_ann_by_lowest_neighbor_asn_tiebreaker(const std::shared_ptr<Announcement>& current_ann, const std::shared_ptr<Announcement>& new_ann);
-    ///////////////////////////////// propagate
-    void propagate(Relationships propagate_to, const std::set<Relationships>& send_rels);
-    bool policy_propagate(const std::weak_ptr<AS>& neighbor_weak, const std::shared_ptr<Announcement>& ann, Relationships propagate_to, const std::set<Relationships>& send_rels);
-    bool prev_sent(const std::weak_ptr<AS>& neighbor_weak, const std::shared_ptr<Announcement>& ann);
-    void process_outgoing_ann(const std::weak_ptr<AS>& neighbor_weak, const std::shared_ptr<Announcement>& ann, Relationships propagate_to, const std::set<Relationships>& send_rels);
-};
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _work_cv.notify_all();
+        for (auto& worker : _workers) {
+            worker.join();
+        }
+    }
 
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
 
+    size_t size() const {
+        return _num_threads;
+    }
 
-class AS : public std::enable_shared_from_this<AS> {
-public:
-    int asn;
-    std::unique_ptr<Policy> policy;
-    std::vector<std::weak_ptr<AS>> peers;
-    std::vector<std::weak_ptr<AS>> customers;
-    std::vector<std::weak_ptr<AS>> providers;
-    bool input_clique;
-    bool ixp;
-    bool stub;
-    bool multihomed;
-    bool transit;
-    long long customer_cone_size;
-    long long propagation_rank;
+    void parallel_for(size_t n, const std::function<void(size_t)>& func) {
+        // Runs func(i) for every i in [0, n) and rethrows the first exception
+        if (_num_threads == 1 || n <= 1) {
+            for (size_t i = 0; i < n; ++i) {
+                func(i);
+            }
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _job = &func;
+            _job_size = n;
+            // Small grains so a few expensive ASes don't leave workers idle
+            _grain = std::max<size_t>(1, n / (_num_threads * 8));
+            _next_index = 0;
+            _error = nullptr;
+            _num_busy = _num_threads - 1;
+            ++_generation;
+        }
+        _work_cv.notify_all();
+        run_job();
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        _done_cv.wait(lock, [this]() { return _num_busy == 0; });
+        _job = nullptr;
+        if (_error) {
+            std::rethrow_exception(_error);
+        }
+    }
 
-    AS(int asn) : asn(asn), policy(std::make_unique<BGPSimplePolicy>()), input_clique(false), ixp(false), stub(false), multihomed(false), transit(false), customer_cone_size(0), propagation_rank(0) {
-        //Can't set this here. AS must already be accessed by shared ptr before calling else err
-        //policy->as = std::weak_ptr<AS>(this->shared_from_this());
+private:
+    size_t _num_threads;
+    std::vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _work_cv;
+    std::condition_variable _done_cv;
+    const std::function<void(size_t)>* _job;
+    size_t _job_size;
+    size_t _grain;
+    std::atomic<size_t> _next_index;
+    size_t _generation;
+    size_t _num_busy;
+    bool _stopping;
+    std::exception_ptr _error;
+
+    void worker_loop(size_t worker_slot) {
+        current_worker_slot() = worker_slot;
+        size_t seen_generation = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _work_cv.wait(lock, [this, seen_generation]() { return _stopping || _generation != seen_generation; });
+                if (_stopping) {
+                    return;
+                }
+                seen_generation = _generation;
+            }
+            run_job();
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (--_num_busy == 0) {
+                    _done_cv.notify_one();
+                }
+            }
+        }
     }
-    // Method to initialize weak_ptr after object is managed by shared_ptr
-    void initialize() {
-        policy->as = std::weak_ptr<AS>(shared_from_this());
+
+    void run_job() {
+        while (true) {
+            size_t begin = _next_index.fetch_add(_grain);
+            if (begin >= _job_size) {
+                return;
+            }
+            size_t end = std::min(begin + _grain, _job_size);
+            try {
+                for (size_t i = begin; i < end; ++i) {
+                    (*_job)(i);
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (!_error) {
+                    _error = std::current_exception();
+                }
+                // Stop handing out more work
+                _next_index = _job_size;
+                return;
+            }
+        }
     }
 };
 
 
-class ASGraph {
+// Bump allocator handing out 32-bit handles. Objects live in fixed size
+// chunks so they never move once allocated, and are only ever freed all at
+// once by clear(), which keeps the chunks around for the next run.
+// Every worker slot bump allocates from a chunk of its own, so workers only
+// synchronize when they claim a new chunk
+template <typename T>
+class Arena {
 public:
-    std::map<int, std::shared_ptr<AS>> as_dict;
-    std::vector<std::vector<std::shared_ptr<AS>>> propagation_ranks;
+    // Objects per chunk is 1 << chunk_bits, at most 1 << MAX_CHUNK_BITS
+    static constexpr uint32_t MAX_CHUNK_BITS = 16;
+    // Chunk pointers are kept in lazily allocated blocks, so the table never
+    // moves while other workers read it and a small arena stays small
+    static constexpr uint32_t BLOCK_BITS = 8;
+    static constexpr uint32_t BLOCK_SIZE = 1u << BLOCK_BITS;
+    static constexpr uint32_t NUM_BLOCKS = 1u << (32 - MAX_CHUNK_BITS - BLOCK_BITS);
+    // One chunk short of the full 32 bits so UINT32_MAX is never handed out
+    static constexpr uint32_t MAX_CHUNKS = NUM_BLOCKS * BLOCK_SIZE - 1;
 
-    void calculatePropagationRanks() {
-        long long max_rank = 0;
-        for (const auto& pair : as_dict) {
-            max_rank = std::max(max_rank, pair.second->propagation_rank);
+protected:
+    struct alignas(64) Cursor {
+        uint32_t next = 0;
+        uint32_t end = 0;
+        uint32_t allocated = 0;
+    };
+
+    MemoryCategory _category;
+    uint32_t _chunk_bits;
+    std::unique_ptr<T[]>* _blocks[NUM_BLOCKS] = {};
+    std::mutex _claim_mutex;
+    uint32_t _next_chunk = 0;
+    uint32_t _num_chunks_allocated = 0;
+    std::vector<Cursor> _cursors;
+
+    void claim_chunk(Cursor& cursor) {
+        std::lock_guard<std::mutex> lock(_claim_mutex);
+        uint32_t chunk = _next_chunk;
+        if (chunk >= MAX_CHUNKS) {
+            throw std::runtime_error("Arena is full.");
+        }
+        auto& block = _blocks[chunk >> BLOCK_BITS];
+        if (!block) {
+            block = new std::unique_ptr<T[]>[BLOCK_SIZE];
+            MemoryCounters::allocated(_category, BLOCK_SIZE * sizeof(std::unique_ptr<T[]>), 0);
+        }
+        auto& chunk_ptr = block[chunk & (BLOCK_SIZE - 1)];
+        if (!chunk_ptr) {
+            chunk_ptr.reset(new T[chunk_size()]);
+            MemoryCounters::allocated(_category, chunk_size() * sizeof(T), chunk_size());
+            ++_num_chunks_allocated;
         }
+        ++_next_chunk;
+        cursor.next = chunk << _chunk_bits;
+        cursor.end = cursor.next + chunk_size();
+    }
 
-        propagation_ranks.resize(max_rank + 1);
+    T& slot(uint32_t id) const {
+        uint32_t chunk = id >> _chunk_bits;
+        return _blocks[chunk >> BLOCK_BITS][chunk & (BLOCK_SIZE - 1)][id & (chunk_size() - 1)];
+    }
 
-        for (const auto& pair : as_dict) {
-            propagation_ranks[pair.second->propagation_rank].push_back(pair.second);
+public:
+    // Small chunks suit arenas that only ever hold a few objects. Chunks
+    // are counted as category in MemoryCounters
+    explicit Arena(MemoryCategory category, uint32_t chunk_bits = MAX_CHUNK_BITS)
+        : _category(category), _chunk_bits(chunk_bits), _cursors(1) {
+        if (chunk_bits > MAX_CHUNK_BITS) {
+            throw std::runtime_error("Arena chunks can hold at most 2^16 objects.");
         }
+    }
 
-        for (auto& rank : propagation_ranks) {
-            std::sort(rank.begin(), rank.end(), [](const std::shared_ptr<AS>& a, const std::shared_ptr<AS>& b) {
-                return a->asn < b->asn;
-            });
+    ~Arena() {
+        for (auto* block : _blocks) {
+            if (block) {
+                MemoryCounters::deallocated(_category, BLOCK_SIZE * sizeof(std::unique_ptr<T[]>), 0);
+            }
+            delete[] block;
         }
+        MemoryCounters::deallocated(_category, static_cast<size_t>(_num_chunks_allocated) * chunk_size() * sizeof(T),
+                                    static_cast<size_t>(_num_chunks_allocated) * chunk_size());
     }
-    ~ASGraph() {
-        // No need to manually delete shared_ptr objects; they will be automatically deleted when they go out of scope.
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void set_num_workers(size_t num_workers) {
+        // Only call while no worker is allocating
+        _cursors.resize(std::max<size_t>(num_workers, 1));
     }
-};
 
-void parseASNList(std::map<int, std::shared_ptr<AS>>& asGraph, const std::string& data, std::vector<std::weak_ptr<AS>>& list) {
-    std::istringstream iss(data.substr(1, data.size() - 2)); // Remove braces
-    std::string asn_str;
-    while (std::getline(iss, asn_str, ',')) {
-        int asn = std::stoi(asn_str);
-        if (asGraph.find(asn) != asGraph.end()) {
-            list.push_back(asGraph[asn]);
+    uint32_t allocate(const T& value) {
+        size_t worker_slot = current_worker_slot();
+        if (worker_slot >= _cursors.size()) {
+            throw std::runtime_error("Arena used from a worker slot it was not sized for.");
+        }
+        Cursor& cursor = _cursors[worker_slot];
+        if (cursor.next == cursor.end) {
+            claim_chunk(cursor);
         }
+        uint32_t id = cursor.next++;
+        ++cursor.allocated;
+        slot(id) = value;
+        return id;
     }
-}
-
-ASGraph readASGraph(const std::string& filename) {
-    auto start = std::chrono::high_resolution_clock::now();
-    std::cout << "Creating AS Graph" << std::endl;
-    ASGraph asGraph;
-    std::ifstream file(filename);
-    std::string line;
 
-    std::getline(file, line);
-    std::string expectedHeaderStart = "asn\tpeers\tcustomers\tproviders\tinput_clique\tixp\tcustomer_cone_size\tpropagation_rank\tstubs\tstub\tmultihomed\ttransit";
-    if (line.find(expectedHeaderStart) != 0) {
-        throw std::runtime_error("File header does not start with the expected format.");
+    T& operator[](uint32_t id) {
+        return slot(id);
     }
 
-    while (std::getline(file, line)) {
-        std::istringstream iss(line);
-        std::vector<std::string> tokens;
-        std::string token;
+    const T& operator[](uint32_t id) const {
+        return slot(id);
+    }
 
-        while (std::getline(iss, token, '\t')) {
-            tokens.push_back(token);
+    uint32_t size() const {
+        // Number of live objects
+        uint32_t size = 0;
+        for (const auto& cursor : _cursors) {
+            size += cursor.allocated;
         }
+        return size;
+    }
 
-        int asn = std::stoi(tokens[0]);
-        // Shared between as_dict and propagation_ranks
-        auto as = std::make_shared<AS>(asn);
-        as->initialize();
-
-        parseASNList(asGraph.as_dict, tokens[1], as->peers);
-        parseASNList(asGraph.as_dict, tokens[2], as->customers);
-        parseASNList(asGraph.as_dict, tokens[3], as->providers);
+    uint32_t chunk_size() const {
+        return 1u << _chunk_bits;
+    }
 
-        as->input_clique = (tokens[4] == "True");
-        as->ixp = (tokens[5] == "True");
-        as->customer_cone_size = std::stoll(tokens[6]);
-        as->propagation_rank = std::stoll(tokens[7]);
-        as->stub = (tokens[9] == "True");
-        as->multihomed = (tokens[10] == "True");
-        as->transit = (tokens[11] == "True");
+    size_t capacity() const {
+        return static_cast<size_t>(_num_chunks_allocated) * chunk_size();
+    }
 
-        asGraph.as_dict[asn] = as;
+    void clear() {
+        // Frees every object at once; chunks are kept for reuse
+        _next_chunk = 0;
+        for (auto& cursor : _cursors) {
+            cursor = Cursor();
+        }
     }
-    asGraph.calculatePropagationRanks();
+};
 
-    auto end = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> elapsed = end - start;
-    std::cout << "Generated ASGraph in "
-              << std::fixed << std::setprecision(2) << elapsed.count() << " seconds." << std::endl;
-    return asGraph;
-}
 
+// Handle to a node in an ASPathStore. Node 0 is always the empty path
+using ASPathID = uint32_t;
+constexpr ASPathID EMPTY_AS_PATH = 0;
 
 
+struct ASPathNode {
+    int asn;           // First ASN of the path this node represents
+    ASPathID parent;   // Rest of the path (everything after asn)
+    uint32_t length;   // Cached so path length comparisons are O(1)
+    uint32_t asn_bits; // Bloom filter of every ASN on the path, see asn_bit()
+};
 
 
+// Persistent cons-list of AS paths. Prepending an ASN to a path is O(1) and
+// every path extended from the same parent shares that parent's nodes, so a
+// path is stored once no matter how many ASes re-announce it.
+class ASPathStore {
+protected:
+    Arena<ASPathNode> _nodes;
 
-///////////BGPSimple implementation. Done outside of the class to avoid circular ref with AS
-void BGPSimplePolicy::process_incoming_anns(Relationships from_rel, int propagation_round, bool reset_q) {
-    // Process all announcements that were incoming from a specific relationship
+public:
+    // Chunk size for stores that hold a single standalone path
+    static constexpr uint32_t SMALL_CHUNK_BITS = 4;
 
-    // For each prefix, get all announcements received
-    for (const auto& [prefix, ann_list] : recvQueue.prefix_anns()) {
-        // Get announcement currently in local RIB
-        auto current_ann = localRIB.get_ann(prefix);
+    explicit ASPathStore(uint32_t chunk_bits = Arena<ASPathNode>::MAX_CHUNK_BITS) : _nodes(MemoryCategory::AS_PATHS, chunk_bits) {
+        clear();
+    }
 
-        // Check if current announcement is seeded; if so, continue
-        if (current_ann && current_ann->seed_asn.has_value()) {
-            continue;
+    static uint32_t asn_bit(int asn) {
+        // One bit per ASN, picked by a multiplicative hash. 32 bits keep a
+        // node at 16 bytes while typical paths still set only a few of them
+        return 1u << ((static_cast<uint32_t>(asn) * 0x9E3779B1u) >> 27);
+    }
+
+    ASPathID prepend(ASPathID parent, int asn) {
+        // Returns the path (asn, *parent)
+        const ASPathNode& parent_node = _nodes[parent];
+        return _nodes.allocate({asn, parent, parent_node.length + 1, parent_node.asn_bits | asn_bit(asn)});
+    }
+
+    ASPathID intern(const int* first, const int* last) {
+        // Builds a path from a sequence, origin (last ASN) first
+        ASPathID path_id = EMPTY_AS_PATH;
+        while (last != first) {
+            path_id = prepend(path_id, *--last);
         }
+        return path_id;
+    }
 
-        std::shared_ptr<Announcement> og_ann = current_ann;
+    ASPathID intern(const std::vector<int>& as_path) {
+        return intern(as_path.data(), as_path.data() + as_path.size());
+    }
 
-        // For each announcement that was incoming
-        for (const auto& new_ann : ann_list) {
-            // Make sure there are no loops
-            if (valid_ann(new_ann, from_rel)) {
-                auto new_ann_processed = copy_and_process(new_ann, from_rel);
+    const ASPathNode& node(ASPathID path_id) const {
+        return _nodes[path_id];
+    }
 
-                current_ann = get_best_ann_by_gao_rexford(current_ann, new_ann_processed);
+    bool contains(ASPathID path_id, int asn) const {
+        // Most ASNs miss the path's filter, which answers without walking it.
+        // A hit may be a false positive, so the path is then checked exactly
+        if (!(_nodes[path_id].asn_bits & asn_bit(asn))) {
+            return false;
+        }
+        for (; path_id != EMPTY_AS_PATH; path_id = _nodes[path_id].parent) {
+            if (_nodes[path_id].asn == asn) {
+                return true;
             }
         }
+        return false;
+    }
 
-        // This is a new best announcement. Process it and add it to the local RIB
-        if (og_ann != current_ann) {
-            // Save to local RIB
-            localRIB.add_ann(current_ann);
-        }
+    uint32_t length(ASPathID path_id) const {
+        return _nodes[path_id].length;
     }
 
-    reset_queue(reset_q);
-}
-void BGPSimplePolicy::propagate_to_providers() {
-    std::set<Relationships> send_rels = {Relationships::ORIGIN, Relationships::CUSTOMERS};
-    propagate(Relationships::PROVIDERS, send_rels);
-}
+    size_t num_nodes() const {
+        return _nodes.size();
+    }
 
-void BGPSimplePolicy::propagate_to_customers() {
-    std::set<Relationships> send_rels = {Relationships::ORIGIN, Relationships::CUSTOMERS, Relationships::PEERS, Relationships::PROVIDERS};
-    propagate(Relationships::CUSTOMERS, send_rels);
-}
+    void set_num_workers(size_t num_workers) {
+        _nodes.set_num_workers(num_workers);
+    }
 
-void BGPSimplePolicy::propagate_to_peers() {
-    std::set<Relationships> send_rels = {Relationships::ORIGIN, Relationships::CUSTOMERS};
-    propagate(Relationships::PEERS, send_rels);
-}
+    void clear() {
+        // Drops every path except the empty one
+        _nodes.clear();
+        _nodes.allocate({0, EMPTY_AS_PATH, 0, 0});
+    }
+};
 
-void BGPSimplePolicy::receive_ann(const std::shared_ptr<Announcement>& ann) {
-    recvQueue.add_ann(ann);
-}
 
-bool BGPSimplePolicy::valid_ann(const std::shared_ptr<Announcement>& ann, Relationships recv_relationship) const {
-    // BGP Loop Prevention Check
-    if (auto as_ptr = as.lock()) { // Safely obtain a shared_ptr from weak_ptr
-        return std::find(ann->as_path.begin(), ann->as_path.end(), as_ptr->asn) == ann->as_path.end();
-    }else{
-        throw std::runtime_error("AS pointer is not valid.");
-    }
-}
-std::shared_ptr<Announcement> BGPSimplePolicy::copy_and_process(const std::shared_ptr<Announcement>& ann, Relationships recv_relationship) {
-    // Check for a valid 'AS' pointer
-    auto as_ptr = as.lock();
-    if (!as_ptr) {
-        throw std::runtime_error("AS pointer is not valid.");
-    }
-
-    // Creating a new announcement with modified attributes
-    std::vector<int> new_as_path = {as_ptr->asn};
-    new_as_path.insert(new_as_path.end(), ann->as_path.begin(), ann->as_path.end());
-
-    // Return a new Announcement object with the modified AS path and recv_relationship
-    return std::make_shared<Announcement>(
-        ann->prefix,
-        new_as_path,
-        ann->timestamp,
-        ann->seed_asn,
-        ann->roa_valid_length,
-        ann->roa_origin,
-        recv_relationship,
-        ann->withdraw,
-        ann->traceback_end,
-        ann->communities
-    );
-}
+// Read only view of one path in an ASPathStore that behaves like a sequence
+// of ASNs, first hop first. Holding the store keeps its nodes alive for
+// announcements that outlive the engine run that created them
+class ASPath {
+protected:
+    std::shared_ptr<ASPathStore> _store;
+    ASPathID _id;
 
-void BGPSimplePolicy::reset_queue(bool reset_q) {
-    if (reset_q) {
-        // Reset the recvQueue by replacing it with a new instance
-        recvQueue = RecvQueue();
+public:
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = int;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const int*;
+        using reference = const int&;
+
+        const_iterator(const ASPathStore* store, ASPathID id) : store(store), id(id) {}
+        reference operator*() const { return store->node(id).asn; }
+        const_iterator& operator++() { id = store->node(id).parent; return *this; }
+        bool operator==(const const_iterator& other) const { return id == other.id; }
+        bool operator!=(const const_iterator& other) const { return id != other.id; }
+
+    private:
+        const ASPathStore* store;
+        ASPathID id;
+    };
+
+    ASPath(std::shared_ptr<ASPathStore> store, ASPathID id) : _store(std::move(store)), _id(id) {}
+
+    // Builds the path in a private store, for announcements made outside an engine
+    explicit ASPath(const std::vector<int>& as_path)
+        : _store(std::make_shared<ASPathStore>(ASPathStore::SMALL_CHUNK_BITS)), _id(EMPTY_AS_PATH) {
+        _id = _store->intern(as_path);
     }
-}
 
+    ASPath prepend(int asn) const {
+        // Returns (asn, *this) in the same store in O(1)
+        return ASPath(_store, _store->prepend(_id, asn));
+    }
 
-/////////////////////////////////////////// gao rexford
+    ASPathID id() const { return _id; }
+    const std::shared_ptr<ASPathStore>& store() const { return _store; }
 
-void BGPSimplePolicy::initialize_gao_rexford_functions() {
+    size_t size() const { return _store->length(_id); }
+    bool empty() const { return _id == EMPTY_AS_PATH; }
+    const_iterator begin() const { return const_iterator(_store.get(), _id); }
+    const_iterator end() const { return const_iterator(_store.get(), EMPTY_AS_PATH); }
 
-    std::cout<<"in init gao"<<std::endl;
-    gao_rexford_functions = {
-        std::bind(&BGPSimplePolicy::get_best_ann_by_local_pref, this, std::placeholders::_1, std::placeholders::_2),
-        std::bind(&BGPSimplePolicy::get_best_ann_by_as_path, this, std::placeholders::_1, std::placeholders::_2),
-        std::bind(&BGPSimplePolicy::get_best_ann_by_lowest_neighbor_asn_tiebreaker, this, std::placeholders::_1, std::placeholders::_2)
-    };
+    int operator[](size_t index) const {
+        // Walks index hops; only used for the first couple of ASNs
+        ASPathID path_id = _id;
+        for (size_t i = 0; i < index; ++i) {
+            path_id = _store->node(path_id).parent;
+        }
+        return _store->node(path_id).asn;
+    }
 
-    std::cout<<"end init gao"<<std::endl;
-}
-std::shared_ptr<Announcement> BGPSimplePolicy::get_best_ann_by_gao_rexford(const std::shared_ptr<Announcement>& current_ann, const std::shared_ptr<Announcement>& new_ann) {
-    if (!new_ann) {
-        throw std::runtime_error("New announcement can't be null.");
+    int back() const {
+        // Returns the origin (last ASN)
+        ASPathID path_id = _id;
+        while (_store->node(path_id).length > 1) {
+            path_id = _store->node(path_id).parent;
+        }
+        return _store->node(path_id).asn;
     }
 
-    if (!current_ann) {
-        return new_ann;
-    } else {
-        for (auto& func : gao_rexford_functions) {
-            auto best_ann = func(current_ann, new_ann);
-            if (best_ann) {
-                return best_ann;
+    bool contains(int asn) const {
+        return _store->contains(_id, asn);
+    }
+
+    std::vector<int> to_vector() const {
+        std::vector<int> as_path;
+        as_path.reserve(size());
+        as_path.assign(begin(), end());
+        return as_path;
+    }
+
+    bool operator==(const ASPath& other) const {
+        if (_store == other._store && _id == other._id) {
+            return true;
+        }
+        return size() == other.size() && std::equal(begin(), end(), other.begin());
+    }
+};
+
+
+class Announcement {
+public:
+    const std::string prefix;
+    // Dense ID assigned by the engine's PrefixTable at setup. All engine
+    // internals key on this rather than on the prefix string
+    const uint32_t prefix_id;
+    const ASPath as_path;
+    const int timestamp;
+    const std::optional<int> seed_asn;
+    const std::optional<bool> roa_valid_length;
+    const std::optional<int> roa_origin;
+    const Relationships recv_relationship;
+    const bool withdraw;
+    const bool traceback_end;
+    const std::vector<std::string> communities;
+
+    // Constructor
+    Announcement(const std::string& prefix, const ASPath& as_path, int timestamp,
+                 const std::optional<int>& seed_asn, const std::optional<bool>& roa_valid_length,
+                 const std::optional<int>& roa_origin, Relationships recv_relationship,
+                 bool withdraw = false, bool traceback_end = false,
+                 const std::vector<std::string>& communities = {},
+                 uint32_t prefix_id = NO_PREFIX_ID)
+        : prefix(prefix), prefix_id(prefix_id), as_path(as_path), timestamp(timestamp),
+          seed_asn(seed_asn), roa_valid_length(roa_valid_length), roa_origin(roa_origin),
+          recv_relationship(recv_relationship), withdraw(withdraw),
+          traceback_end(traceback_end), communities(communities) {}
+
+    Announcement(const std::string& prefix, const std::vector<int>& as_path, int timestamp,
+                 const std::optional<int>& seed_asn, const std::optional<bool>& roa_valid_length,
+                 const std::optional<int>& roa_origin, Relationships recv_relationship,
+                 bool withdraw = false, bool traceback_end = false,
+                 const std::vector<std::string>& communities = {},
+                 uint32_t prefix_id = NO_PREFIX_ID)
+        : Announcement(prefix, ASPath(as_path), timestamp, seed_asn, roa_valid_length, roa_origin,
+                       recv_relationship, withdraw, traceback_end, communities, prefix_id) {}
+
+    // Methods
+    bool prefix_path_attributes_eq(const Announcement* ann) const {
+        if (!ann) {
+            return false;
+        }
+        // Only fall back to the strings if either side was never interned
+        if (ann->prefix_id != NO_PREFIX_ID && this->prefix_id != NO_PREFIX_ID) {
+            return ann->prefix_id == this->prefix_id && ann->as_path == this->as_path;
+        }
+        return ann->prefix == this->prefix && ann->as_path == this->as_path;
+    }
+
+    bool invalid_by_roa() const {
+        if (!roa_origin.has_value()) {
+            return false;
+        }
+        return origin() != roa_origin.value() || !roa_valid_length.value();
+    }
+
+    bool valid_by_roa() const {
+        return roa_origin.has_value() && origin() == roa_origin.value() && roa_valid_length.value();
+    }
+
+    bool unknown_by_roa() const {
+        return !invalid_by_roa() && !valid_by_roa();
+    }
+
+    bool covered_by_roa() const {
+        return !unknown_by_roa();
+    }
+
+    bool roa_routed() const {
+        return roa_origin.has_value() && roa_origin.value() != 0;
+    }
+
+    int origin() const {
+        if (!as_path.empty()) {
+            return as_path.back();
+        }
+        return -1; // Or another appropriate default value
+    }
+};
+
+
+template <typename... Args>
+std::shared_ptr<Announcement> make_announcement(Args&&... args) {
+    // Announcements made by C++ are counted as MemoryCategory::ANNOUNCEMENTS
+    return std::allocate_shared<Announcement>(CountingAllocator<Announcement, MemoryCategory::ANNOUNCEMENTS>(),
+                                              std::forward<Args>(args)...);
+}
+
+
+// Announcements stored by column in memory owned by the caller, e.g. NumPy
+// arrays. Every pointer is to size elements, except path_offsets (size + 1)
+// and path_asns (path_offsets[size]). Optional columns may be null
+struct AnnouncementArrays {
+    size_t size = 0;
+    // Prefix of row i is prefixes[prefix_ids[i]]
+    const std::vector<std::string>* prefixes = nullptr;
+    const uint32_t* prefix_ids = nullptr;
+    const uint32_t* path_offsets = nullptr;
+    const int32_t* path_asns = nullptr;
+    const int32_t* seed_asns = nullptr;
+    // Codes as in the announcements TSV: 0 or 4 origin, 1 providers, 2 peers, 3 customers
+    const uint8_t* recv_relationships = nullptr;
+    const int32_t* timestamps = nullptr;
+    // -1 for None, as is an absent column. The two are independent, as
+    // in the announcements TSV; valid lengths are otherwise 0 or 1
+    const int8_t* roa_valid_lengths = nullptr;
+    const int32_t* roa_origins = nullptr;
+    // Bit 0 withdraw, bit 1 traceback_end
+    const uint8_t* flags = nullptr;
+};
+
+constexpr uint8_t ANN_FLAG_WITHDRAW = 1 << 0;
+constexpr uint8_t ANN_FLAG_TRACEBACK_END = 1 << 1;
+
+
+// Announcements to seed, stored by column so that loading and seeding a
+// large file needs no object per row. Prefixes and communities are interned;
+// prefix IDs are assigned in order of first appearance, so they are the IDs
+// the engine will use
+class AnnouncementBatch {
+public:
+    PrefixTable prefix_table;
+    CountedVector<uint32_t, MemoryCategory::ANNOUNCEMENTS> prefix_ids;
+    // The AS path of row i is path_asns[path_offsets[i]] to path_asns[path_offsets[i + 1]]
+    CountedVector<uint32_t, MemoryCategory::ANNOUNCEMENTS> path_offsets{0};
+    CountedVector<int, MemoryCategory::ANNOUNCEMENTS> path_asns;
+    CountedVector<int, MemoryCategory::ANNOUNCEMENTS> timestamps;
+    CountedVector<std::optional<int>, MemoryCategory::ANNOUNCEMENTS> seed_asns;
+    CountedVector<std::optional<bool>, MemoryCategory::ANNOUNCEMENTS> roa_valid_lengths;
+    CountedVector<std::optional<int>, MemoryCategory::ANNOUNCEMENTS> roa_origins;
+    CountedVector<Relationships, MemoryCategory::ANNOUNCEMENTS> recv_relationships;
+    CountedVector<uint8_t, MemoryCategory::ANNOUNCEMENTS> withdraws;
+    CountedVector<uint8_t, MemoryCategory::ANNOUNCEMENTS> traceback_ends;
+    // Interned like prefixes. Row i's communities are community_ids[community_offsets[i]]
+    // to community_ids[community_offsets[i + 1]]
+    CommunityTable community_table;
+    CountedVector<uint32_t, MemoryCategory::COMMUNITIES> community_offsets{0};
+    CountedVector<uint32_t, MemoryCategory::COMMUNITIES> community_ids;
+
+    size_t size() const {
+        return prefix_ids.size();
+    }
+
+    void end_row() {
+        // Call after adding a row's fields and appending its ASNs and communities
+        if (path_asns.size() > UINT32_MAX || community_ids.size() > UINT32_MAX) {
+            throw std::runtime_error("Announcement batch is too large.");
+        }
+        path_offsets.push_back(static_cast<uint32_t>(path_asns.size()));
+        community_offsets.push_back(static_cast<uint32_t>(community_ids.size()));
+    }
+
+    void add(const Announcement& ann) {
+        prefix_ids.push_back(prefix_table.intern(ann.prefix));
+        path_asns.insert(path_asns.end(), ann.as_path.begin(), ann.as_path.end());
+        timestamps.push_back(ann.timestamp);
+        seed_asns.push_back(ann.seed_asn);
+        roa_valid_lengths.push_back(ann.roa_valid_length);
+        roa_origins.push_back(ann.roa_origin);
+        recv_relationships.push_back(ann.recv_relationship);
+        withdraws.push_back(ann.withdraw);
+        traceback_ends.push_back(ann.traceback_end);
+        for (const auto& community : ann.communities) {
+            community_ids.push_back(community_table.intern(community));
+        }
+        end_row();
+    }
+
+    void append(const AnnouncementBatch& other) {
+        // Adds other's rows after this batch's, re-interning its strings
+        std::vector<uint32_t> prefix_ids_map(other.prefix_table.size());
+        for (uint32_t prefix_id = 0; prefix_id < prefix_ids_map.size(); ++prefix_id) {
+            prefix_ids_map[prefix_id] = prefix_table.intern(other.prefix_table.get_prefix(prefix_id));
+        }
+        std::vector<uint32_t> community_ids_map(other.community_table.size());
+        for (uint32_t community_id = 0; community_id < community_ids_map.size(); ++community_id) {
+            community_ids_map[community_id] = community_table.intern(other.community_table.get_prefix(community_id));
+        }
+
+        for (uint32_t prefix_id : other.prefix_ids) {
+            prefix_ids.push_back(prefix_ids_map[prefix_id]);
+        }
+        path_asns.insert(path_asns.end(), other.path_asns.begin(), other.path_asns.end());
+        for (uint32_t community_id : other.community_ids) {
+            community_ids.push_back(community_ids_map[community_id]);
+        }
+        timestamps.insert(timestamps.end(), other.timestamps.begin(), other.timestamps.end());
+        seed_asns.insert(seed_asns.end(), other.seed_asns.begin(), other.seed_asns.end());
+        roa_valid_lengths.insert(roa_valid_lengths.end(), other.roa_valid_lengths.begin(), other.roa_valid_lengths.end());
+        roa_origins.insert(roa_origins.end(), other.roa_origins.begin(), other.roa_origins.end());
+        recv_relationships.insert(recv_relationships.end(), other.recv_relationships.begin(), other.recv_relationships.end());
+        withdraws.insert(withdraws.end(), other.withdraws.begin(), other.withdraws.end());
+        traceback_ends.insert(traceback_ends.end(), other.traceback_ends.begin(), other.traceback_ends.end());
+
+        uint32_t path_base = path_offsets.back();
+        uint32_t community_base = community_offsets.back();
+        for (size_t row = 1; row < other.path_offsets.size(); ++row) {
+            path_offsets.push_back(path_base + other.path_offsets[row]);
+            community_offsets.push_back(community_base + other.community_offsets[row]);
+        }
+    }
+
+    std::vector<int> as_path(size_t row) const {
+        return std::vector<int>(path_asns.begin() + path_offsets[row], path_asns.begin() + path_offsets[row + 1]);
+    }
+
+    std::vector<std::string> communities(size_t row) const {
+        std::vector<std::string> communities;
+        for (uint32_t i = community_offsets[row]; i < community_offsets[row + 1]; ++i) {
+            communities.push_back(community_table.get_prefix(community_ids[i]));
+        }
+        return communities;
+    }
+
+    bool invalid_by_roa(size_t row) const {
+        // Same as Announcement::invalid_by_roa, treating a missing
+        // roa_valid_length as valid
+        if (!roa_origins[row].has_value()) {
+            return false;
+        }
+        int origin = path_offsets[row + 1] > path_offsets[row] ? path_asns[path_offsets[row + 1] - 1] : -1;
+        return origin != roa_origins[row].value() || !roa_valid_lengths[row].value_or(true);
+    }
+
+    std::shared_ptr<Announcement> get(size_t row) const {
+        // Materializes one row (Python boundary only)
+        if (row >= size()) {
+            throw std::out_of_range("Announcement batch index out of range.");
+        }
+        return make_announcement(
+            prefix_table.get_prefix(prefix_ids[row]), as_path(row), timestamps[row], seed_asns[row],
+            roa_valid_lengths[row], roa_origins[row], recv_relationships[row], withdraws[row],
+            traceback_ends[row], communities(row));
+    }
+
+    std::vector<std::shared_ptr<Announcement>> to_announcements() const {
+        std::vector<std::shared_ptr<Announcement>> announcements;
+        announcements.reserve(size());
+        for (size_t row = 0; row < size(); ++row) {
+            announcements.push_back(get(row));
+        }
+        return announcements;
+    }
+
+    static std::shared_ptr<AnnouncementBatch> from_arrays(const AnnouncementArrays& arrays) {
+        // Validates the columns and copies each of them in bulk
+        if (!arrays.prefixes || !arrays.prefix_ids || !arrays.path_offsets || !arrays.path_asns ||
+            !arrays.seed_asns || !arrays.recv_relationships) {
+            throw std::runtime_error("Announcement arrays are missing a required column.");
+        }
+        size_t size = arrays.size;
+        auto batch = std::make_shared<AnnouncementBatch>();
+        for (const auto& prefix : *arrays.prefixes) {
+            if (batch->prefix_table.intern(prefix) != batch->prefix_table.size() - 1) {
+                throw std::runtime_error("Duplicate prefix in prefix table: " + prefix);
+            }
+        }
+
+        batch->prefix_ids.assign(arrays.prefix_ids, arrays.prefix_ids + size);
+        if (std::any_of(batch->prefix_ids.begin(), batch->prefix_ids.end(),
+                        [&](uint32_t prefix_id) { return prefix_id >= arrays.prefixes->size(); })) {
+            throw std::runtime_error("Prefix ID not in prefix table.");
+        }
+        batch->path_offsets.assign(arrays.path_offsets, arrays.path_offsets + size + 1);
+        if (batch->path_offsets.front() != 0 || !std::is_sorted(batch->path_offsets.begin(), batch->path_offsets.end())) {
+            throw std::runtime_error("AS path offsets must start at 0 and be non-decreasing.");
+        }
+        batch->path_asns.assign(arrays.path_asns, arrays.path_asns + batch->path_offsets.back());
+
+        batch->seed_asns.reserve(size);
+        batch->recv_relationships.reserve(size);
+        batch->roa_valid_lengths.reserve(size);
+        batch->roa_origins.reserve(size);
+        batch->withdraws.reserve(size);
+        batch->traceback_ends.reserve(size);
+        for (size_t row = 0; row < size; ++row) {
+            batch->seed_asns.push_back(arrays.seed_asns[row]);
+            switch (arrays.recv_relationships[row]) {
+                case 0: batch->recv_relationships.push_back(Relationships::ORIGIN); break;
+                case 1: batch->recv_relationships.push_back(Relationships::PROVIDERS); break;
+                case 2: batch->recv_relationships.push_back(Relationships::PEERS); break;
+                case 3: batch->recv_relationships.push_back(Relationships::CUSTOMERS); break;
+                case 4: batch->recv_relationships.push_back(Relationships::ORIGIN); break;
+                default:
+                    throw std::runtime_error("Invalid recv_relationship value: " + std::to_string(arrays.recv_relationships[row]));
+            }
+            if (arrays.roa_valid_lengths && arrays.roa_valid_lengths[row] >= 0) {
+                batch->roa_valid_lengths.push_back(arrays.roa_valid_lengths[row] != 0);
+            } else {
+                batch->roa_valid_lengths.push_back(std::nullopt);
+            }
+            if (arrays.roa_origins && arrays.roa_origins[row] >= 0) {
+                batch->roa_origins.push_back(arrays.roa_origins[row]);
+            } else {
+                batch->roa_origins.push_back(std::nullopt);
+            }
+            uint8_t flags = arrays.flags ? arrays.flags[row] : 0;
+            batch->withdraws.push_back((flags & ANN_FLAG_WITHDRAW) != 0);
+            batch->traceback_ends.push_back((flags & ANN_FLAG_TRACEBACK_END) != 0);
+        }
+        if (arrays.timestamps) {
+            batch->timestamps.assign(arrays.timestamps, arrays.timestamps + size);
+        } else {
+            batch->timestamps.assign(size, 0);
+        }
+        // No communities
+        batch->community_offsets.assign(size + 1, 0);
+        return batch;
+    }
+
+    static std::shared_ptr<AnnouncementBatch> from_announcements(const std::vector<std::shared_ptr<Announcement>>& announcements) {
+        auto batch = std::make_shared<AnnouncementBatch>();
+        for (const auto& ann : announcements) {
+            if (!ann) {
+                throw std::runtime_error("Null announcement in the list");
+            }
+            batch->add(*ann);
+        }
+        return batch;
+    }
+};
+
+
+// Storage layouts for LocalRIB. MAP is the original red-black tree; SPARSE
+// is a sorted flat vector; DENSE is a direct array indexed by prefix ID.
+// AUTO starts SPARSE and promotes an AS to DENSE once it holds a large
+// enough share of the prefix table
+enum class LocalRIBBackend {
+    MAP = 1,
+    SPARSE = 2,
+    DENSE = 3,
+    AUTO = 4
+};
+
+
+// How CPPSimulationEngine::run spreads propagation over its threads
+enum class PropagationMode {
+    // ASes of the same propagation rank are processed in parallel
+    RANK_PARALLEL = 1,
+    // Prefixes are split into shards that are each propagated by one thread
+    PREFIX_SHARDED = 2
+};
+
+
+// File formats of CPPSimulationEngine::dump_local_ribs
+enum class RIBDumpFormat {
+    // One line per RIB entry, with the columns of the comparison files
+    TSV = 1,
+    // Columnar arrays in the snapshot layout; see dump_local_ribs
+    BINARY = 2
+};
+
+
+// Handle to an Ann in an AnnouncementArena
+using AnnID = uint32_t;
+constexpr AnnID NO_ANN = UINT32_MAX;
+
+
+// Compact announcement used inside the engine. Everything that is the same
+// for every copy of a seeded announcement (timestamp, ROA, communities...)
+// stays on the seed's Announcement and is reached through seed_index
+struct Ann {
+    uint32_t prefix_id;
+    ASPathID as_path;
+    uint32_t seed_index;
+    Relationships recv_relationship;
+    // Only true in the local RIB of the AS it was seeded at
+    bool seeded;
+    // Set once at seeding. Prepending never changes the origin, so every
+    // copy of a seeded announcement has the same ROA state
+    bool invalid_by_roa;
+};
+
+
+// Per-engine storage for every Ann and AS path created during a run. Policies
+// refer to announcements by AnnID; Announcement objects (and shared_ptrs) are
+// only built from these when results cross the Python boundary
+class AnnouncementArena {
+protected:
+    Arena<Ann> _anns;
+    std::shared_ptr<ASPathStore> _as_path_store;
+    size_t _num_workers;
+
+public:
+    AnnouncementArena() : _anns(MemoryCategory::ANNS), _as_path_store(std::make_shared<ASPathStore>()), _num_workers(1) {}
+
+    void set_num_workers(size_t num_workers) {
+        // Number of worker slots that may add announcements concurrently
+        _num_workers = num_workers;
+        _anns.set_num_workers(num_workers);
+        _as_path_store->set_num_workers(num_workers);
+    }
+
+    AnnID add(const Ann& ann) {
+        return _anns.allocate(ann);
+    }
+
+    const Ann& operator[](AnnID ann_id) const {
+        return _anns[ann_id];
+    }
+
+    ASPathStore& as_paths() {
+        return *_as_path_store;
+    }
+
+    const ASPathStore& as_paths() const {
+        return *_as_path_store;
+    }
+
+    const std::shared_ptr<ASPathStore>& as_path_store() const {
+        return _as_path_store;
+    }
+
+    uint32_t size() const {
+        return _anns.size();
+    }
+
+    void reset() {
+        // Frees every announcement and path wholesale
+        _anns.clear();
+        if (_as_path_store.use_count() == 1) {
+            _as_path_store->clear();
+        } else {
+            // Announcements handed to Python still read paths from the old store
+            _as_path_store = std::make_shared<ASPathStore>();
+            _as_path_store->set_num_workers(_num_workers);
+        }
+    }
+};
+
+
+class LocalRIB {
+public:
+    using entry_type = std::pair<uint32_t, AnnID>;
+    using map_type = std::map<uint32_t, AnnID, std::less<uint32_t>,
+                              CountingAllocator<std::pair<const uint32_t, AnnID>, MemoryCategory::LOCAL_RIBS>>;
+
+    // AUTO promotes to DENSE once size * this >= number of prefixes
+    static constexpr size_t DENSE_PROMOTION_FACTOR = 4;
+
+protected:
+    LocalRIBBackend _backend;
+    // As passed to configure(); _backend differs once AUTO promotes
+    LocalRIBBackend _configured_backend;
+    size_t _num_prefixes;
+    size_t _size;
+    map_type _map_info;
+    // Sorted by prefix ID
+    CountedVector<entry_type, MemoryCategory::LOCAL_RIBS> _sparse_info;
+    // Indexed by prefix ID, NO_ANN where there is no announcement
+    CountedVector<AnnID, MemoryCategory::LOCAL_RIBS> _dense_info;
+    // Prefix IDs in the order their entries were set, with repeats
+    CountedVector<uint32_t, MemoryCategory::RIB_CHANGES> _changes;
+    // Length of _changes when entries were last sent to providers, peers
+    // and customers, indexed by watermark_index()
+    size_t _watermarks[3] = {0, 0, 0};
+
+    static size_t watermark_index(Relationships propagate_to) {
+        switch (propagate_to) {
+            case Relationships::PROVIDERS: return 0;
+            case Relationships::PEERS: return 1;
+            case Relationships::CUSTOMERS: return 2;
+            default: throw std::runtime_error("Unsupported relationship type.");
+        }
+    }
+
+    CountedVector<entry_type, MemoryCategory::LOCAL_RIBS>::const_iterator sparse_find(uint32_t prefix_id) const {
+        return std::lower_bound(_sparse_info.begin(), _sparse_info.end(), prefix_id,
+                                [](const entry_type& entry, uint32_t id) { return entry.first < id; });
+    }
+
+    void promote_to_dense() {
+        // Moves the sparse entries into a direct array
+        _dense_info.assign(_num_prefixes, NO_ANN);
+        for (const auto& [prefix_id, ann_id] : _sparse_info) {
+            _dense_info[prefix_id] = ann_id;
+        }
+        decltype(_sparse_info)().swap(_sparse_info);
+        _backend = LocalRIBBackend::DENSE;
+    }
+
+public:
+    LocalRIB() : _backend(LocalRIBBackend::MAP), _configured_backend(LocalRIBBackend::MAP), _num_prefixes(0), _size(0) {}
+
+    void configure(LocalRIBBackend backend, size_t num_prefixes) {
+        // Selects the storage layout. Must be called while the RIB is empty.
+        // Storage is kept if nothing changed, e.g. between trials
+        if (_size != 0) {
+            throw std::runtime_error("Can't change the LocalRIB backend of a non empty RIB.");
+        }
+        if (backend == _configured_backend && num_prefixes == _num_prefixes) {
+            return;
+        }
+        _configured_backend = backend;
+        _num_prefixes = num_prefixes;
+        _map_info.clear();
+        decltype(_sparse_info)().swap(_sparse_info);
+        decltype(_dense_info)().swap(_dense_info);
+        if (backend == LocalRIBBackend::DENSE) {
+            _dense_info.assign(num_prefixes, NO_ANN);
+        }
+        _backend = backend;
+    }
+
+    LocalRIBBackend backend() const {
+        // AUTO reports SPARSE until this RIB has been promoted
+        return _backend;
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+    AnnID get_ann(uint32_t prefix_id, AnnID default_ann = NO_ANN) const {
+        // Returns announcement or NO_ANN from the local rib by prefix ID
+        switch (_backend) {
+            case LocalRIBBackend::DENSE:
+                if (prefix_id < _dense_info.size() && _dense_info[prefix_id] != NO_ANN) {
+                    return _dense_info[prefix_id];
+                }
+                return default_ann;
+            case LocalRIBBackend::MAP: {
+                auto it = _map_info.find(prefix_id);
+                if (it != _map_info.end()) {
+                    return it->second;
+                }
+                return default_ann;
+            }
+            default: {
+                auto it = sparse_find(prefix_id);
+                if (it != _sparse_info.end() && it->first == prefix_id) {
+                    return it->second;
+                }
+                return default_ann;
+            }
+        }
+    }
+
+    void add_ann(uint32_t prefix_id, AnnID ann_id) {
+        // Adds an announcement to local rib with prefix ID as key
+        switch (_backend) {
+            case LocalRIBBackend::DENSE: {
+                if (prefix_id >= _dense_info.size()) {
+                    throw std::runtime_error("Prefix ID out of range for dense LocalRIB.");
+                }
+                auto& slot = _dense_info[prefix_id];
+                if (slot == ann_id) {
+                    return;
+                }
+                if (slot == NO_ANN) {
+                    ++_size;
+                }
+                slot = ann_id;
+                _changes.push_back(prefix_id);
+                return;
+            }
+            case LocalRIBBackend::MAP: {
+                auto inserted = _map_info.try_emplace(prefix_id, ann_id);
+                if (inserted.second) {
+                    ++_size;
+                } else if (inserted.first->second == ann_id) {
+                    return;
+                } else {
+                    inserted.first->second = ann_id;
+                }
+                _changes.push_back(prefix_id);
+                return;
+            }
+            default: {
+                auto it = _sparse_info.begin() + (sparse_find(prefix_id) - _sparse_info.cbegin());
+                if (it != _sparse_info.end() && it->first == prefix_id) {
+                    if (it->second != ann_id) {
+                        it->second = ann_id;
+                        _changes.push_back(prefix_id);
+                    }
+                    return;
+                }
+                _sparse_info.emplace(it, prefix_id, ann_id);
+                _changes.push_back(prefix_id);
+                ++_size;
+                if (_backend == LocalRIBBackend::AUTO && _size * DENSE_PROMOTION_FACTOR >= _num_prefixes) {
+                    promote_to_dense();
+                }
+                return;
+            }
+        }
+    }
+
+    const CountedVector<uint32_t, MemoryCategory::RIB_CHANGES>& changes() const {
+        // Prefix IDs whose entry was set, oldest first. A prefix shows up
+        // once per change; removals are not recorded
+        return _changes;
+    }
+
+    size_t watermark(Relationships propagate_to) const {
+        // Entries of changes() from here on weren't sent to propagate_to yet
+        return _watermarks[watermark_index(propagate_to)];
+    }
+
+    void advance_watermark(Relationships propagate_to) {
+        // Marks every change so far as sent to propagate_to. The log is
+        // dropped once all three relationships have caught up with it
+        _watermarks[watermark_index(propagate_to)] = _changes.size();
+        if (std::all_of(std::begin(_watermarks), std::end(_watermarks),
+                        [this](size_t mark) { return mark == _changes.size(); })) {
+            clear_changes();
+        }
+    }
+
+    void mark_changed(uint32_t prefix_id) {
+        // Logs prefix_id as changed, as if its entry had just been set
+        _changes.push_back(prefix_id);
+    }
+
+    void clear_changes() {
+        // Frees the log; a converged RIB has nothing left to send
+        CountedVector<uint32_t, MemoryCategory::RIB_CHANGES>().swap(_changes);
+        std::fill(std::begin(_watermarks), std::end(_watermarks), 0);
+    }
+
+    void clear() {
+        // Removes every announcement, keeping the backend and its storage
+        clear_changes();
+        if (_size == 0) {
+            return;
+        }
+        _size = 0;
+        _map_info.clear();
+        _sparse_info.clear();
+        std::fill(_dense_info.begin(), _dense_info.end(), NO_ANN);
+    }
+
+    void remove_ann(uint32_t prefix_id) {
+        // Removes announcement from local rib based on prefix ID
+        switch (_backend) {
+            case LocalRIBBackend::DENSE:
+                if (prefix_id < _dense_info.size() && _dense_info[prefix_id] != NO_ANN) {
+                    _dense_info[prefix_id] = NO_ANN;
+                    --_size;
+                }
+                return;
+            case LocalRIBBackend::MAP:
+                _size -= _map_info.erase(prefix_id);
+                return;
+            default: {
+                auto it = sparse_find(prefix_id);
+                if (it != _sparse_info.end() && it->first == prefix_id) {
+                    _sparse_info.erase(it);
+                    --_size;
+                }
+                return;
+            }
+        }
+    }
+
+    // Iterates (prefix ID, announcement) pairs in prefix ID order for every backend
+    class const_iterator {
+    public:
+        using value_type = std::pair<uint32_t, AnnID>;
+
+        const_iterator(const LocalRIB* rib, map_type::const_iterator map_it, size_t index)
+            : rib(rib), map_it(map_it), index(index) {
+            skip_empty();
+        }
+
+        value_type operator*() const {
+            switch (rib->_backend) {
+                case LocalRIBBackend::DENSE:
+                    return {static_cast<uint32_t>(index), rib->_dense_info[index]};
+                case LocalRIBBackend::MAP:
+                    return {map_it->first, map_it->second};
+                default:
+                    return {rib->_sparse_info[index].first, rib->_sparse_info[index].second};
+            }
+        }
+
+        const_iterator& operator++() {
+            if (rib->_backend == LocalRIBBackend::MAP) {
+                ++map_it;
+            } else {
+                ++index;
+                skip_empty();
+            }
+            return *this;
+        }
+
+        bool operator!=(const const_iterator& other) const {
+            return map_it != other.map_it || index != other.index;
+        }
+
+    private:
+        const LocalRIB* rib;
+        map_type::const_iterator map_it;
+        size_t index;
+
+        void skip_empty() {
+            // Dense arrays are scanned linearly, skipping prefixes with no announcement
+            if (rib->_backend == LocalRIBBackend::DENSE) {
+                while (index < rib->_dense_info.size() && rib->_dense_info[index] == NO_ANN) {
+                    ++index;
+                }
+            }
+        }
+    };
+
+    class PrefixAnnsView {
+    public:
+        explicit PrefixAnnsView(const LocalRIB* rib) : rib(rib) {}
+        const_iterator begin() const {
+            return const_iterator(rib, rib->_map_info.begin(), 0);
+        }
+        const_iterator end() const {
+            size_t end_index = 0;
+            switch (rib->_backend) {
+                case LocalRIBBackend::DENSE: end_index = rib->_dense_info.size(); break;
+                case LocalRIBBackend::MAP: break;
+                default: end_index = rib->_sparse_info.size(); break;
+            }
+            return const_iterator(rib, rib->_map_info.end(), end_index);
+        }
+    private:
+        const LocalRIB* rib;
+    };
+
+    PrefixAnnsView prefix_anns() const {
+        // Returns all prefix IDs and announcements zipped
+        return PrefixAnnsView(this);
+    }
+};
+
+
+class RecvQueue {
+public:
+    using entry_type = std::pair<uint32_t, AnnID>;
+
+    // Queues that grew past this many entries give their memory back on reset
+    static constexpr size_t MAX_RETAINED_CAPACITY = 1024;
+
+protected:
+    // Flat (prefix ID, announcement) list, grouped by prefix in sort_by_prefix()
+    CountedVector<entry_type, MemoryCategory::RECV_QUEUES> _info;
+    // Neighbors in the same propagation rank may send concurrently
+    std::mutex _mutex;
+    // Entries added, and the most held at once, since reset_counters()
+    uint64_t _num_received = 0;
+    size_t _peak_size = 0;
+
+public:
+    RecvQueue() {}
+
+    void add_ann(uint32_t prefix_id, AnnID ann_id) {
+        // Appends ann to the list of received announcements
+        std::lock_guard<std::mutex> lock(_mutex);
+        _info.emplace_back(prefix_id, ann_id);
+        ++_num_received;
+        _peak_size = std::max(_peak_size, _info.size());
+    }
+
+    void add_anns(const std::vector<entry_type>& entries) {
+        // Appends everything one neighbor sent, taking the lock once
+        std::lock_guard<std::mutex> lock(_mutex);
+        _info.insert(_info.end(), entries.begin(), entries.end());
+        _num_received += entries.size();
+        _peak_size = std::max(_peak_size, _info.size());
+    }
+
+    void sort_by_prefix() {
+        // Groups the received announcements by prefix ID, in prefix ID order
+        std::sort(_info.begin(), _info.end());
+    }
+
+    const CountedVector<entry_type, MemoryCategory::RECV_QUEUES>& prefix_anns() const {
+        // Returns all (prefix ID, announcement) pairs; sort first to group them
+        return _info;
+    }
+
+    size_t size() const {
+        return _info.size();
+    }
+
+    uint64_t num_received() const {
+        return _num_received;
+    }
+
+    size_t peak_size() const {
+        return _peak_size;
+    }
+
+    void reset_counters() {
+        _num_received = 0;
+        _peak_size = 0;
+    }
+
+    void clear() {
+        if (_info.capacity() > MAX_RETAINED_CAPACITY) {
+            decltype(_info)().swap(_info);
+        } else {
+            _info.clear();
+        }
+    }
+};
+
+
+
+// What the Gao-Rexford decision looks at, for an announcement that is either
+// already in the local RIB or was received and would be copied into it
+struct RouteAttributes {
+    Relationships recv_relationship;
+    uint32_t path_length;
+    int neighbor_asn;
+};
+
+
+// Steps of the Gao-Rexford decision process. compare() is negative when the
+// current announcement is better, positive when the new one is, and zero
+// when the step can't tell them apart
+
+struct PreferLocalPref {
+    // Customers over peers over providers
+    static int compare(const RouteAttributes& current_ann, const RouteAttributes& new_ann) {
+        return static_cast<int>(new_ann.recv_relationship) - static_cast<int>(current_ann.recv_relationship);
+    }
+};
+
+struct PreferShortestASPath {
+    static int compare(const RouteAttributes& current_ann, const RouteAttributes& new_ann) {
+        return (current_ann.path_length > new_ann.path_length) - (current_ann.path_length < new_ann.path_length);
+    }
+};
+
+struct PreferLowestNeighborASN {
+    static int compare(const RouteAttributes& current_ann, const RouteAttributes& new_ann) {
+        return (current_ann.neighbor_asn > new_ann.neighbor_asn) - (current_ann.neighbor_asn < new_ann.neighbor_asn);
+    }
+};
+
+
+// A decision process made of steps, applied in order until one of them has
+// a preference. Resolved at compile time, so a chain of the steps above is
+// a handful of integer comparisons with no calls. Policies extend a chain
+// with append, e.g. BGPSimplePolicy::DecisionProcess::append<MyStep>
+template <typename... Steps>
+struct DecisionChain {
+    template <typename... MoreSteps>
+    using append = DecisionChain<Steps..., MoreSteps...>;
+
+    static bool prefers_new(const RouteAttributes& current_ann, const RouteAttributes& new_ann) {
+        // The current announcement is kept when every step ties
+        int preference = 0;
+        (((preference = Steps::compare(current_ann, new_ann)) != 0) || ...);
+        return preference > 0;
+    }
+};
+
+
+// Import filters, applied to received announcements along with loop
+// prevention. Like the decision steps, resolved at compile time
+struct AcceptAllAnns {
+    static bool accepts(const Ann&) {
+        return true;
+    }
+};
+
+struct RejectInvalidByROA {
+    static bool accepts(const Ann& ann) {
+        return !ann.invalid_by_roa;
+    }
+};
+
+
+class ASGraph; // Forward declaration
+class PolicySet;
+
+
+// What process_incoming_anns() did with received announcements, summed
+// into RunMetrics after every run
+struct PolicyCounters {
+    uint64_t processed = 0;
+    // Became the AS's route for their prefix
+    uint64_t accepted = 0;
+    uint64_t rejected_by_loop = 0;
+    uint64_t rejected_by_filter = 0;
+};
+
+class Policy {
+public:
+    // The AS this policy belongs to is as_graph's AS at as_index
+    const ASGraph* as_graph;
+    uint32_t as_index;
+    LocalRIB localRIB;
+    RecvQueue recvQueue;
+    // Set by the engine; every Ann this policy creates or reads lives here
+    AnnouncementArena* ann_arena;
+    // Policies of the neighbors, indexed like the graph. Usually the
+    // engine's policies; a prefix shard has a set of its own
+    PolicySet* neighbor_policies;
+    // Only written by the thread running this policy; reset by run()
+    PolicyCounters counters;
+
+    Policy() : as_graph(nullptr), as_index(0), ann_arena(nullptr), neighbor_policies(nullptr) {}
+
+    virtual void receive_ann(uint32_t prefix_id, AnnID ann_id) = 0;
+    virtual void receive_anns(const std::vector<RecvQueue::entry_type>& entries) = 0;
+    virtual void process_incoming_anns(Relationships from_rel, int propagation_round, bool reset_q = true) = 0;
+    virtual void propagate_to_providers() = 0;
+    virtual void propagate_to_customers() = 0;
+    virtual void propagate_to_peers() = 0;
+
+    virtual void reset() {
+        // Drops all routing state, keeping allocated storage for the next trial
+        localRIB.clear();
+        recvQueue.clear();
+    }
+
+    // You need virtual destructors in base class or else derived classes
+    // won't clean up properly
+    virtual ~Policy() = default; // Virtual and uses the default implementation
+};
+
+
+// Runs one propagation step for a batch of ASes that all use the same
+// policy class. The engine calls these instead of the virtual methods
+struct PolicyKernels {
+    void (*process_incoming_anns)(Policy* const* policies, size_t n, Relationships from_rel, int propagation_round);
+    void (*propagate_to_providers)(Policy* const* policies, size_t n);
+    void (*propagate_to_peers)(Policy* const* policies, size_t n);
+    void (*propagate_to_customers)(Policy* const* policies, size_t n);
+};
+
+
+// The kernels of one policy class. Calls are qualified with the class, so
+// they are bound statically and the compiler can inline them into the loop
+template <typename PolicyType>
+struct PolicyBatchKernels {
+    static void process_incoming_anns(Policy* const* policies, size_t n, Relationships from_rel, int propagation_round) {
+        for (size_t i = 0; i < n; ++i) {
+            static_cast<PolicyType*>(policies[i])->PolicyType::process_incoming_anns(from_rel, propagation_round);
+        }
+    }
+
+    static void propagate_to_providers(Policy* const* policies, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            static_cast<PolicyType*>(policies[i])->PolicyType::propagate_to_providers();
+        }
+    }
+
+    static void propagate_to_peers(Policy* const* policies, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            static_cast<PolicyType*>(policies[i])->PolicyType::propagate_to_peers();
+        }
+    }
+
+    static void propagate_to_customers(Policy* const* policies, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            static_cast<PolicyType*>(policies[i])->PolicyType::propagate_to_customers();
+        }
+    }
+
+    static const PolicyKernels& kernels() {
+        static const PolicyKernels kernels = {
+            &process_incoming_anns, &propagate_to_providers, &propagate_to_peers, &propagate_to_customers
+        };
+        return kernels;
+    }
+};
+
+
+// Owns every policy of one class in a policy set, in one contiguous block
+class PolicyBlock {
+public:
+    virtual Policy& operator[](size_t i) = 0;
+    virtual ~PolicyBlock() = default;
+};
+
+
+template <typename PolicyType>
+class TypedPolicyBlock : public PolicyBlock {
+public:
+    explicit TypedPolicyBlock(size_t size) : _size(size), _policies(new PolicyType[size]) {
+        MemoryCounters::allocated(MemoryCategory::POLICIES, size * sizeof(PolicyType), size);
+    }
+
+    ~TypedPolicyBlock() override {
+        MemoryCounters::deallocated(MemoryCategory::POLICIES, _size * sizeof(PolicyType), _size);
+    }
+
+    PolicyType& operator[](size_t i) override {
+        return _policies[i];
+    }
+
+protected:
+    size_t _size;
+    std::unique_ptr<PolicyType[]> _policies;
+};
+
+
+// A registered policy class: how to allocate it and how to run it
+struct PolicyClass {
+    std::function<std::unique_ptr<PolicyBlock>(size_t)> make_block;
+    const PolicyKernels* kernels;
+};
+
+
+// The policy of every AS in the graph, indexed by AS index. Policies are
+// allocated per class, and each propagation rank is split into groups of
+// one class so a rank costs one kernel dispatch per class, not one per AS
+class PolicySet {
+public:
+    struct Group {
+        const PolicyKernels* kernels;
+        std::vector<Policy*> policies;
+    };
+
+    std::vector<Policy*> policies;
+    std::vector<std::unique_ptr<PolicyBlock>> blocks;
+    // Groups of every AS in as_graph->propagation_ranks[i]
+    std::vector<std::vector<Group>> rank_groups;
+    // Groups of every AS in the graph
+    std::vector<Group> all_groups;
+
+    // ASes nothing is sent to during propagation. Their routes are computed
+    // from their neighbors' when asked for; see CPPSimulationEngine::lazy_stubs
+    enum class LazyState : uint8_t {
+        PROPAGATED = 0,
+        LAZY = 1
+    };
+    // Indexed by AS index; empty when every AS is propagated. Only changed
+    // by setup(), so it can be read while stubs materialize in parallel
+    std::vector<LazyState> lazy_states;
+    // Whether a lazy stub's routes are computed, by AS index. One byte per
+    // AS, only written by the task materializing that AS
+    std::vector<uint8_t> materialized;
+
+    bool is_lazy(uint32_t as_index) const {
+        return !lazy_states.empty() && lazy_states[as_index] != LazyState::PROPAGATED;
+    }
+
+    Policy& operator[](uint32_t as_index) {
+        return *policies[as_index];
+    }
+
+    const Policy& operator[](uint32_t as_index) const {
+        return *policies[as_index];
+    }
+
+    size_t size() const {
+        return policies.size();
+    }
+
+    std::vector<Policy*>::const_iterator begin() const {
+        return policies.begin();
+    }
+
+    std::vector<Policy*>::const_iterator end() const {
+        return policies.end();
+    }
+};
+
+
+class BGPSimplePolicy : public Policy {
+public:
+    // Gao-Rexford: local preference, then AS path length, then neighbor ASN
+    using DecisionProcess = DecisionChain<PreferLocalPref, PreferShortestASPath, PreferLowestNeighborASN>;
+    using ImportFilter = AcceptAllAnns;
+
+    BGPSimplePolicy() : Policy() {}
+    // You need virtual destructors in base class or else derived classes
+    // won't clean up properly
+    virtual ~BGPSimplePolicy() override = default; // Virtual and uses the default implementation
+
+    void process_incoming_anns(Relationships from_rel, int propagation_round, bool reset_q = true) override;
+    void propagate_to_providers() override;
+    void propagate_to_customers() override;
+    void propagate_to_peers() override;
+    void receive_ann(uint32_t prefix_id, AnnID ann_id) override;
+    void receive_anns(const std::vector<RecvQueue::entry_type>& entries) override;
+protected:
+    // What propagate() is about to send to one neighbor. Per thread, since
+    // ASes in the same rank propagate concurrently
+    static thread_local std::vector<RecvQueue::entry_type> outgoing_anns;
+    // Entries changed since the last send to the relationship propagate()
+    // sends to, and the prefix IDs they are gathered from
+    static thread_local std::vector<RecvQueue::entry_type> pending_anns;
+    static thread_local std::vector<uint32_t> pending_prefix_ids;
+
+    bool valid_ann(AnnID ann_id, Relationships recv_relationship) const;
+    AnnID copy_and_process(AnnID ann_id, Relationships recv_relationship);
+    void reset_queue(bool reset_q);
+    // process_incoming_anns() with a given decision process and import
+    // filter. Policies with their own DecisionProcess or ImportFilter
+    // override process_incoming_anns() to call this with them
+    template <typename Decision, typename Filter = AcceptAllAnns>
+    void process_incoming_anns_with(Relationships from_rel, bool reset_q);
+    RouteAttributes rib_ann_attributes(AnnID ann_id) const;
+    RouteAttributes received_ann_attributes(AnnID ann_id, Relationships recv_relationship) const;
+    ///////////////////////////////// propagate
+    void propagate(Relationships propagate_to, const std::set<Relationships>& send_rels);
+    bool policy_propagate(uint32_t neighbor_index, AnnID ann_id, Relationships propagate_to, const std::set<Relationships>& send_rels);
+    void collect_pending_anns(Relationships propagate_to, const std::set<Relationships>& send_rels);
+    void process_outgoing_ann(uint32_t neighbor_index, AnnID ann_id, Relationships propagate_to, const std::set<Relationships>& send_rels);
+};
+
+
+// Route origin validation: BGPSimplePolicy that drops announcements that are
+// invalid by ROA. The ROA state is computed once per seed, so the filter is
+// a flag test and costs no more than BGPSimplePolicy
+class ROVSimplePolicy : public BGPSimplePolicy {
+public:
+    using ImportFilter = RejectInvalidByROA;
+
+    ROVSimplePolicy() : BGPSimplePolicy() {}
+    virtual ~ROVSimplePolicy() override = default;
+
+    void process_incoming_anns(Relationships from_rel, int propagation_round, bool reset_q = true) override;
+};
+
+
+// Indices of neighboring ASes, a slice of one of ASGraph's CSR arrays
+class ASIndexRange {
+public:
+    ASIndexRange(const uint32_t* first, const uint32_t* last) : first(first), last(last) {}
+    const uint32_t* begin() const { return first; }
+    const uint32_t* end() const { return last; }
+    size_t size() const { return static_cast<size_t>(last - first); }
+    bool empty() const { return first == last; }
+private:
+    const uint32_t* first;
+    const uint32_t* last;
+};
+
+
+// Compressed sparse row adjacency for one relationship: the neighbors of
+// AS index i are indices[offsets[i]] up to (not including) indices[offsets[i + 1]]
+class CSRAdjacency {
+public:
+    CountedVector<uint32_t, MemoryCategory::AS_GRAPH> offsets;
+    CountedVector<uint32_t, MemoryCategory::AS_GRAPH> indices;
+
+    ASIndexRange neighbors(uint32_t as_index) const {
+        return ASIndexRange(indices.data() + offsets[as_index], indices.data() + offsets[as_index + 1]);
+    }
+};
+
+
+// Fields that propagation never reads, kept apart from the hot arrays
+struct ASInfo {
+    long long customer_cone_size;
+    bool input_clique;
+    bool ixp;
+    bool stub;
+    bool multihomed;
+    bool transit;
+};
+
+
+constexpr uint32_t NO_AS_INDEX = UINT32_MAX;
+
+
+// ASes are stored by index (their position in ASN order) in parallel arrays.
+// Propagation only touches asns, as_propagation_ranks, policies and the
+// adjacency arrays; everything else is in as_info
+class ASGraph {
+public:
+    CountedVector<int, MemoryCategory::AS_GRAPH> asns;
+    CountedVector<uint32_t, MemoryCategory::AS_GRAPH> as_propagation_ranks;
+    CSRAdjacency providers;
+    CSRAdjacency peers;
+    CSRAdjacency customers;
+    CountedVector<ASInfo, MemoryCategory::AS_GRAPH> as_info;
+    std::unordered_map<int, uint32_t, std::hash<int>, std::equal_to<int>,
+                       CountingAllocator<std::pair<const int, uint32_t>, MemoryCategory::AS_GRAPH>> asn_to_index;
+    // AS indices in each propagation rank, in ASN order
+    CountedVector<CountedVector<uint32_t, MemoryCategory::AS_GRAPH>, MemoryCategory::AS_GRAPH> propagation_ranks;
+
+    size_t size() const {
+        return asns.size();
+    }
+
+    uint32_t get_index(int asn) const {
+        // Returns the AS index of an ASN, or NO_AS_INDEX if it is not in the graph
+        auto it = asn_to_index.find(asn);
+        if (it != asn_to_index.end()) {
+            return it->second;
+        }
+        return NO_AS_INDEX;
+    }
+
+    ASIndexRange neighbors(uint32_t as_index, Relationships relationship) const {
+        switch (relationship) {
+            case Relationships::PROVIDERS:
+                return providers.neighbors(as_index);
+            case Relationships::PEERS:
+                return peers.neighbors(as_index);
+            case Relationships::CUSTOMERS:
+                return customers.neighbors(as_index);
+            default:
+                throw std::runtime_error("Unsupported relationship type.");
+        }
+    }
+
+    void calculatePropagationRanks() {
+        uint32_t max_rank = 0;
+        for (uint32_t rank : as_propagation_ranks) {
+            max_rank = std::max(max_rank, rank);
+        }
+
+        propagation_ranks.assign(size() ? max_rank + 1 : 0, {});
+
+        // AS indices are in ASN order, so each rank comes out sorted by ASN
+        for (uint32_t as_index = 0; as_index < size(); ++as_index) {
+            propagation_ranks[as_propagation_ranks[as_index]].push_back(as_index);
+        }
+    }
+};
+
+
+// Collects the rows of a graph file in any order and turns them into an
+// ASGraph once every ASN is known, so neighbors listed before their own
+// row are still linked
+class ASGraphBuilder {
+public:
+    struct NeighborLists {
+        // Neighbor ASNs of row r are asns[row_offsets[r]] to asns[row_offsets[r + 1]]
+        std::vector<uint32_t> row_offsets{0};
+        std::vector<int> asns;
+
+        void append(const NeighborLists& other) {
+            uint32_t base = static_cast<uint32_t>(asns.size());
+            for (size_t row = 1; row < other.row_offsets.size(); ++row) {
+                row_offsets.push_back(base + other.row_offsets[row]);
+            }
+            asns.insert(asns.end(), other.asns.begin(), other.asns.end());
+        }
+    };
+
+    std::vector<int> asns;
+    std::vector<uint32_t> as_propagation_ranks;
+    std::vector<ASInfo> as_info;
+    NeighborLists providers;
+    NeighborLists peers;
+    NeighborLists customers;
+
+    void end_row() {
+        // Call after adding a row's fields and appending its neighbor ASNs
+        providers.row_offsets.push_back(static_cast<uint32_t>(providers.asns.size()));
+        peers.row_offsets.push_back(static_cast<uint32_t>(peers.asns.size()));
+        customers.row_offsets.push_back(static_cast<uint32_t>(customers.asns.size()));
+    }
+
+    void append(const ASGraphBuilder& other) {
+        // Adds other's rows after this builder's, e.g. to join chunks parsed in parallel
+        asns.insert(asns.end(), other.asns.begin(), other.asns.end());
+        as_propagation_ranks.insert(as_propagation_ranks.end(), other.as_propagation_ranks.begin(), other.as_propagation_ranks.end());
+        as_info.insert(as_info.end(), other.as_info.begin(), other.as_info.end());
+        providers.append(other.providers);
+        peers.append(other.peers);
+        customers.append(other.customers);
+    }
+
+    std::unique_ptr<ASGraph> build() const {
+        auto as_graph = std::make_unique<ASGraph>();
+        size_t num_ases = asns.size();
+
+        // AS index order is ASN order
+        std::vector<uint32_t> rows(num_ases);
+        for (uint32_t row = 0; row < num_ases; ++row) {
+            rows[row] = row;
+        }
+        std::sort(rows.begin(), rows.end(), [this](uint32_t a, uint32_t b) { return asns[a] < asns[b]; });
+
+        as_graph->asns.resize(num_ases);
+        as_graph->as_propagation_ranks.resize(num_ases);
+        as_graph->as_info.resize(num_ases);
+        as_graph->asn_to_index.reserve(num_ases);
+        for (uint32_t as_index = 0; as_index < num_ases; ++as_index) {
+            uint32_t row = rows[as_index];
+            if (!as_graph->asn_to_index.emplace(asns[row], as_index).second) {
+                throw std::runtime_error("Duplicate ASN in AS graph: " + std::to_string(asns[row]));
+            }
+            as_graph->asns[as_index] = asns[row];
+            as_graph->as_propagation_ranks[as_index] = as_propagation_ranks[row];
+            as_graph->as_info[as_index] = as_info[row];
+        }
+
+        build_adjacency(*as_graph, rows, providers, as_graph->providers);
+        build_adjacency(*as_graph, rows, peers, as_graph->peers);
+        build_adjacency(*as_graph, rows, customers, as_graph->customers);
+        as_graph->calculatePropagationRanks();
+        return as_graph;
+    }
+
+protected:
+    static void build_adjacency(const ASGraph& as_graph, const std::vector<uint32_t>& rows,
+                                const NeighborLists& lists, CSRAdjacency& adjacency) {
+        adjacency.offsets.assign(1, 0);
+        adjacency.offsets.reserve(rows.size() + 1);
+        adjacency.indices.clear();
+        adjacency.indices.reserve(lists.asns.size());
+        for (uint32_t row : rows) {
+            for (uint32_t i = lists.row_offsets[row]; i < lists.row_offsets[row + 1]; ++i) {
+                // Neighbors without a row of their own are dropped
+                uint32_t neighbor_index = as_graph.get_index(lists.asns[i]);
+                if (neighbor_index != NO_AS_INDEX) {
+                    adjacency.indices.push_back(neighbor_index);
+                }
+            }
+            adjacency.offsets.push_back(static_cast<uint32_t>(adjacency.indices.size()));
+        }
+    }
+};
+
+// Read only view of a whole file. Memory mapped where the platform allows,
+// so parsing reads straight from the page cache
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& filename) {
+#if defined(__unix__) || defined(__APPLE__)
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Could not open file: " + filename);
+        }
+        struct stat file_stat;
+        if (::fstat(fd, &file_stat) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Could not stat file: " + filename);
+        }
+        _size = static_cast<size_t>(file_stat.st_size);
+        if (_size > 0) {
+            void* mapping = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("Could not map file: " + filename);
+            }
+            ::madvise(mapping, _size, MADV_SEQUENTIAL);
+            _data = static_cast<const char*>(mapping);
+        }
+        // The mapping stays valid after the descriptor is closed
+        ::close(fd);
+#else
+        std::ifstream file(filename, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Could not open file: " + filename);
+        }
+        _buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        _data = _buffer.data();
+        _size = _buffer.size();
+#endif
+    }
+
+    ~MappedFile() {
+#if defined(__unix__) || defined(__APPLE__)
+        if (_data) {
+            ::munmap(const_cast<char*>(_data), _size);
+        }
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const {
+        return _data;
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+protected:
+    const char* _data = nullptr;
+    size_t _size = 0;
+#if !defined(__unix__) && !defined(__APPLE__)
+    std::string _buffer;
+#endif
+};
+
+
+// Parses tab separated fields in place, without copying them into strings.
+// Every read_* consumes one field and the tab after it
+class TSVCursor {
+public:
+    TSVCursor(const char* first, const char* last) : _pos(first), _last(last) {}
+
+    bool at_end() const {
+        return _pos == _last;
+    }
+
+    bool at_line_end() const {
+        return _pos == _last || *_pos == '\n' || *_pos == '\r';
+    }
+
+    bool field_empty() const {
+        return at_line_end() || *_pos == '\t';
+    }
+
+    std::string_view read_field() {
+        const char* field_end = find_field_end();
+        std::string_view field(_pos, field_end - _pos);
+        _pos = field_end;
+        end_field();
+        return field;
+    }
+
+    template <typename Int>
+    Int read_int() {
+        skip_spaces();
+        Int value;
+        auto [ptr, ec] = std::from_chars(_pos, _last, value);
+        if (ec != std::errc()) {
+            throw error("integer");
+        }
+        _pos = ptr;
+        end_field();
+        return value;
+    }
+
+    template <typename Int>
+    std::optional<Int> read_optional_int() {
+        // An empty field is None
+        if (field_empty()) {
+            end_field();
+            return std::nullopt;
+        }
+        return read_int<Int>();
+    }
+
+    std::optional<bool> read_optional_bool() {
+        if (field_empty()) {
+            end_field();
+            return std::nullopt;
+        }
+        return read_bool();
+    }
+
+    bool read_bool() {
+        // Python's True; anything else is false
+        const char* field_end = find_field_end();
+        bool value = field_end - _pos == 4 && std::memcmp(_pos, "True", 4) == 0;
+        _pos = field_end;
+        end_field();
+        return value;
+    }
+
+    template <typename Allocator>
+    void read_asn_list(std::vector<int, Allocator>& list) {
+        // Appends the ASNs of a {1,2,3} field to list
+        if (_pos == _last || *_pos != '{') {
+            throw error("ASN list");
+        }
+        ++_pos;
+        skip_spaces();
+        if (_pos != _last && *_pos == '}') {
+            ++_pos;
+        } else {
+            while (true) {
+                skip_spaces();
+                int asn;
+                auto [ptr, ec] = std::from_chars(_pos, _last, asn);
+                if (ec != std::errc()) {
+                    throw error("ASN list");
+                }
+                list.push_back(asn);
+                _pos = ptr;
+                skip_spaces();
+                if (_pos == _last) {
+                    throw error("ASN list");
+                } else if (*_pos == ',') {
+                    ++_pos;
+                } else if (*_pos == '}') {
+                    ++_pos;
+                    break;
+                } else {
+                    throw error("ASN list");
+                }
+            }
+        }
+        end_field();
+    }
+
+    void skip_field() {
+        _pos = find_field_end();
+        end_field();
+    }
+
+    void next_line() {
+        // Skips whatever is left of the current line
+        const char* newline = static_cast<const char*>(std::memchr(_pos, '\n', _last - _pos));
+        _pos = newline ? newline + 1 : _last;
+    }
+
+protected:
+    const char* _pos;
+    const char* _last;
+
+    const char* find_field_end() const {
+        const char* p = _pos;
+        while (p != _last && *p != '\t' && *p != '\n' && *p != '\r') {
+            ++p;
+        }
+        return p;
+    }
+
+    void skip_spaces() {
+        while (_pos != _last && *_pos == ' ') {
+            ++_pos;
+        }
+    }
+
+    void end_field() {
+        // Steps over the tab; line ends are left for next_line()
+        if (_pos != _last && *_pos == '\t') {
+            ++_pos;
+        } else if (_pos != _last && *_pos != '\n' && *_pos != '\r') {
+            throw error("field");
+        }
+    }
+
+    std::runtime_error error(const std::string& what) const {
+        const char* line_end = static_cast<const char*>(std::memchr(_pos, '\n', _last - _pos));
+        return std::runtime_error("Malformed " + what + " in TSV line at: " +
+                                  std::string(_pos, std::min<size_t>((line_end ? line_end : _last) - _pos, 80)));
+    }
+};
+
+
+bool skipTSVHeader(const char*& first, const char* last, const std::string& expected_header_start) {
+    // Moves first past the header line, if it starts as expected
+    const char* header_end = first != last ? static_cast<const char*>(std::memchr(first, '\n', last - first)) : nullptr;
+    header_end = header_end ? header_end + 1 : last;
+    if (static_cast<size_t>(header_end - first) < expected_header_start.size() ||
+        std::memcmp(first, expected_header_start.data(), expected_header_start.size()) != 0) {
+        return false;
+    }
+    first = header_end;
+    return true;
+}
+
+std::vector<const char*> splitLines(const char* first, const char* last, size_t num_chunks) {
+    // Returns the bounds of up to num_chunks roughly equal chunks of
+    // [first, last), split after newlines: chunk i is [bounds[i], bounds[i + 1])
+    std::vector<const char*> bounds{first};
+    for (size_t chunk = 1; chunk < num_chunks; ++chunk) {
+        const char* split = std::max(bounds.back(), first + (last - first) * chunk / num_chunks);
+        const char* newline = static_cast<const char*>(std::memchr(split, '\n', last - split));
+        if (!newline) {
+            break;
+        }
+        bounds.push_back(newline + 1);
+    }
+    bounds.push_back(last);
+    return bounds;
+}
+
+void parseASGraphRows(const char* first, const char* last, ASGraphBuilder& builder) {
+    // Parses every CAIDA TSV row in [first, last) into builder
+    TSVCursor cursor(first, last);
+    while (!cursor.at_end()) {
+        builder.asns.push_back(cursor.read_int<int>());
+
+        cursor.read_asn_list(builder.peers.asns);
+        cursor.read_asn_list(builder.customers.asns);
+        cursor.read_asn_list(builder.providers.asns);
+
+        ASInfo info;
+        info.input_clique = cursor.read_bool();
+        info.ixp = cursor.read_bool();
+        info.customer_cone_size = cursor.read_int<long long>();
+        builder.as_propagation_ranks.push_back(cursor.read_int<uint32_t>());
+        cursor.skip_field();  // stubs
+        info.stub = cursor.read_bool();
+        info.multihomed = cursor.read_bool();
+        info.transit = cursor.read_bool();
+        builder.as_info.push_back(info);
+
+        builder.end_row();
+        cursor.next_line();
+    }
+}
+
+std::unique_ptr<ASGraph> readASGraph(const std::string& filename, size_t num_threads = 1) {
+    // Parses the file straight from a memory map. With several threads the
+    // rows are split into chunks on line boundaries and joined in file order
+    auto start = std::chrono::high_resolution_clock::now();
+    std::cout << "Creating AS Graph" << std::endl;
+    MappedFile file(filename);
+    const char* first = file.data();
+    const char* last = first + file.size();
+
+    std::string expectedHeaderStart = "asn\tpeers\tcustomers\tproviders\tinput_clique\tixp\tcustomer_cone_size\tpropagation_rank\tstubs\tstub\tmultihomed\ttransit";
+    if (!skipTSVHeader(first, last, expectedHeaderStart)) {
+        throw std::runtime_error("File header does not start with the expected format.");
+    }
+
+    std::vector<const char*> chunk_starts = splitLines(first, last, num_threads);
+    std::vector<ASGraphBuilder> chunk_builders(chunk_starts.size() - 1);
+    ThreadPool thread_pool(chunk_builders.size());
+    thread_pool.parallel_for(chunk_builders.size(), [&](size_t chunk) {
+        parseASGraphRows(chunk_starts[chunk], chunk_starts[chunk + 1], chunk_builders[chunk]);
+    });
+
+    ASGraphBuilder& builder = chunk_builders[0];
+    for (size_t chunk = 1; chunk < chunk_builders.size(); ++chunk) {
+        builder.append(chunk_builders[chunk]);
+    }
+    auto asGraph = builder.build();
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed = end - start;
+    std::cout << "Generated ASGraph in "
+              << std::fixed << std::setprecision(2) << elapsed.count() << " seconds." << std::endl;
+    return asGraph;
+}
+
+
+// Binary snapshot of a parsed ASGraph: a header followed by flat arrays,
+// each a uint64 element count and the elements, padded to 8 bytes. Loading
+// one is a bounds checked copy of each array, with nothing to parse or
+// recompute. Snapshots are only read on machines with the byte order and
+// version they were written with
+struct ASGraphSnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+};
+
+constexpr char AS_GRAPH_SNAPSHOT_MAGIC[8] = {'E', 'X', 'R', 'G', 'R', 'A', 'P', 'H'};
+constexpr uint32_t AS_GRAPH_SNAPSHOT_VERSION = 1;
+constexpr uint32_t AS_GRAPH_SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+// Binary dumps of local RIBs share the snapshot layout
+constexpr char RIB_DUMP_MAGIC[8] = {'E', 'X', 'R', 'R', 'I', 'B', 'S', '\0'};
+constexpr uint32_t RIB_DUMP_VERSION = 1;
+
+// ASInfo's flags, packed into one byte per AS
+enum ASInfoFlags : uint8_t {
+    INPUT_CLIQUE = 1 << 0,
+    IXP = 1 << 1,
+    STUB = 1 << 2,
+    MULTIHOMED = 1 << 3,
+    TRANSIT = 1 << 4
+};
+
+
+class ASGraphSnapshotWriter {
+public:
+    explicit ASGraphSnapshotWriter(const std::string& filename) : _file(filename, std::ios::binary) {
+        if (!_file) {
+            throw std::runtime_error("Could not open snapshot file for writing: " + filename);
+        }
+    }
+
+    void write_header(const char* magic = AS_GRAPH_SNAPSHOT_MAGIC, uint32_t version = AS_GRAPH_SNAPSHOT_VERSION) {
+        // Other files in the same layout pass their own magic and version
+        ASGraphSnapshotHeader header;
+        std::memcpy(header.magic, magic, sizeof(header.magic));
+        header.version = version;
+        header.byte_order = AS_GRAPH_SNAPSHOT_BYTE_ORDER;
+        write_bytes(&header, sizeof(header));
+    }
+
+    template <typename T, typename Allocator>
+    void write_array(const std::vector<T, Allocator>& values) {
+        static_assert(std::is_trivially_copyable<T>::value, "Snapshot arrays must be trivially copyable");
+        uint64_t count = values.size();
+        write_bytes(&count, sizeof(count));
+        write_bytes(values.data(), values.size() * sizeof(T));
+        static const char padding[8] = {};
+        write_bytes(padding, (8 - (values.size() * sizeof(T)) % 8) % 8);
+    }
+
+    void close() {
+        _file.close();
+        if (!_file) {
+            throw std::runtime_error("Failed writing snapshot file.");
+        }
+    }
+
+protected:
+    std::ofstream _file;
+
+    void write_bytes(const void* data, size_t size) {
+        _file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    }
+};
+
+
+class ASGraphSnapshotReader {
+public:
+    explicit ASGraphSnapshotReader(const std::string& filename) : _file(filename), _pos(0) {}
+
+    void read_header() {
+        ASGraphSnapshotHeader header;
+        read_bytes(&header, sizeof(header));
+        if (std::memcmp(header.magic, AS_GRAPH_SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+            throw std::runtime_error("Not an AS graph snapshot.");
+        }
+        if (header.byte_order != AS_GRAPH_SNAPSHOT_BYTE_ORDER) {
+            throw std::runtime_error("AS graph snapshot was written with a different byte order.");
+        }
+        if (header.version != AS_GRAPH_SNAPSHOT_VERSION) {
+            throw std::runtime_error("Unsupported AS graph snapshot version: " + std::to_string(header.version));
+        }
+    }
+
+    template <typename T, typename Allocator>
+    void read_array(std::vector<T, Allocator>& values) {
+        uint64_t count;
+        read_bytes(&count, sizeof(count));
+        if (count > (_file.size() - _pos) / sizeof(T)) {
+            throw std::runtime_error("AS graph snapshot is truncated.");
+        }
+        values.resize(count);
+        read_bytes(values.data(), count * sizeof(T));
+        _pos += std::min<size_t>((8 - (count * sizeof(T)) % 8) % 8, _file.size() - _pos);
+    }
+
+protected:
+    MappedFile _file;
+    size_t _pos;
+
+    void read_bytes(void* data, size_t size) {
+        if (size > _file.size() - _pos) {
+            throw std::runtime_error("AS graph snapshot is truncated.");
+        }
+        if (size > 0) {
+            std::memcpy(data, _file.data() + _pos, size);
+        }
+        _pos += size;
+    }
+};
+
+
+void writeASGraphSnapshot(const ASGraph& as_graph, const std::string& filename) {
+    std::vector<long long> customer_cone_sizes(as_graph.size());
+    std::vector<uint8_t> flags(as_graph.size());
+    for (size_t as_index = 0; as_index < as_graph.size(); ++as_index) {
+        const ASInfo& info = as_graph.as_info[as_index];
+        customer_cone_sizes[as_index] = info.customer_cone_size;
+        flags[as_index] = (info.input_clique ? INPUT_CLIQUE : 0) | (info.ixp ? IXP : 0) | (info.stub ? STUB : 0) |
+                          (info.multihomed ? MULTIHOMED : 0) | (info.transit ? TRANSIT : 0);
+    }
+    // Propagation ranks are stored like the adjacency, as offsets and AS indices
+    CSRAdjacency ranks;
+    ranks.offsets.assign(1, 0);
+    for (const auto& rank : as_graph.propagation_ranks) {
+        ranks.indices.insert(ranks.indices.end(), rank.begin(), rank.end());
+        ranks.offsets.push_back(static_cast<uint32_t>(ranks.indices.size()));
+    }
+
+    ASGraphSnapshotWriter writer(filename);
+    writer.write_header();
+    writer.write_array(as_graph.asns);
+    writer.write_array(as_graph.as_propagation_ranks);
+    writer.write_array(customer_cone_sizes);
+    writer.write_array(flags);
+    for (const CSRAdjacency* adjacency : std::initializer_list<const CSRAdjacency*>{&as_graph.providers, &as_graph.peers, &as_graph.customers, &ranks}) {
+        writer.write_array(adjacency->offsets);
+        writer.write_array(adjacency->indices);
+    }
+    writer.close();
+}
+
+std::unique_ptr<ASGraph> readASGraphSnapshot(const std::string& filename) {
+    auto start = std::chrono::high_resolution_clock::now();
+    auto as_graph = std::make_unique<ASGraph>();
+    std::vector<long long> customer_cone_sizes;
+    std::vector<uint8_t> flags;
+    CSRAdjacency ranks;
+
+    ASGraphSnapshotReader reader(filename);
+    reader.read_header();
+    reader.read_array(as_graph->asns);
+    reader.read_array(as_graph->as_propagation_ranks);
+    reader.read_array(customer_cone_sizes);
+    reader.read_array(flags);
+    for (CSRAdjacency* adjacency : {&as_graph->providers, &as_graph->peers, &as_graph->customers, &ranks}) {
+        reader.read_array(adjacency->offsets);
+        reader.read_array(adjacency->indices);
+    }
+
+    size_t num_ases = as_graph->size();
+    auto valid_adjacency = [num_ases](const CSRAdjacency& adjacency, size_t num_rows) {
+        if (adjacency.offsets.size() != num_rows + 1 || adjacency.offsets.front() != 0 ||
+            adjacency.offsets.back() != adjacency.indices.size() ||
+            !std::is_sorted(adjacency.offsets.begin(), adjacency.offsets.end())) {
+            return false;
+        }
+        return std::all_of(adjacency.indices.begin(), adjacency.indices.end(),
+                           [num_ases](uint32_t as_index) { return as_index < num_ases; });
+    };
+    if (as_graph->as_propagation_ranks.size() != num_ases || customer_cone_sizes.size() != num_ases ||
+        flags.size() != num_ases || ranks.offsets.empty() ||
+        !valid_adjacency(as_graph->providers, num_ases) || !valid_adjacency(as_graph->peers, num_ases) ||
+        !valid_adjacency(as_graph->customers, num_ases) || !valid_adjacency(ranks, ranks.offsets.size() - 1)) {
+        throw std::runtime_error("AS graph snapshot is corrupt.");
+    }
+
+    as_graph->as_info.resize(num_ases);
+    as_graph->asn_to_index.reserve(num_ases);
+    for (uint32_t as_index = 0; as_index < num_ases; ++as_index) {
+        ASInfo& info = as_graph->as_info[as_index];
+        info.customer_cone_size = customer_cone_sizes[as_index];
+        info.input_clique = flags[as_index] & INPUT_CLIQUE;
+        info.ixp = flags[as_index] & IXP;
+        info.stub = flags[as_index] & STUB;
+        info.multihomed = flags[as_index] & MULTIHOMED;
+        info.transit = flags[as_index] & TRANSIT;
+        if (!as_graph->asn_to_index.emplace(as_graph->asns[as_index], as_index).second) {
+            throw std::runtime_error("AS graph snapshot is corrupt.");
+        }
+    }
+    as_graph->propagation_ranks.resize(ranks.offsets.size() - 1);
+    for (size_t rank = 0; rank < as_graph->propagation_ranks.size(); ++rank) {
+        ASIndexRange as_indices = ranks.neighbors(static_cast<uint32_t>(rank));
+        as_graph->propagation_ranks[rank].assign(as_indices.begin(), as_indices.end());
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed = end - start;
+    std::cout << "Loaded ASGraph snapshot in "
+              << std::fixed << std::setprecision(2) << elapsed.count() << " seconds." << std::endl;
+    return as_graph;
+}
+
+void parseAnnouncementRows(const char* first, const char* last, AnnouncementBatch& batch) {
+    // Parses every announcement TSV row in [first, last) into batch
+    TSVCursor cursor(first, last);
+    std::string prefix;
+    while (!cursor.at_end()) {
+        if (cursor.at_line_end()) {
+            cursor.next_line();
+            continue;
+        }
+        std::string_view prefix_field = cursor.read_field();
+        prefix.assign(prefix_field.data(), prefix_field.size());
+        batch.prefix_ids.push_back(batch.prefix_table.intern(prefix));
+
+        if (cursor.field_empty()) {
+            cursor.skip_field();
+        } else {
+            cursor.read_asn_list(batch.path_asns);
+        }
+        batch.timestamps.push_back(cursor.read_int<int>());
+        batch.seed_asns.push_back(cursor.read_optional_int<int>());
+        batch.roa_valid_lengths.push_back(cursor.read_optional_bool());
+        batch.roa_origins.push_back(cursor.read_optional_int<int>());
+
+        // Parse recv_relationship (convert to enum)
+        if (cursor.field_empty()) {
+            throw std::runtime_error("Missing or empty recv_relationship value.");
+        }
+        int rel_value = cursor.read_int<int>();
+        switch (rel_value) {
+            case 0: batch.recv_relationships.push_back(Relationships::ORIGIN); break;
+            case 1: batch.recv_relationships.push_back(Relationships::PROVIDERS); break;
+            case 2: batch.recv_relationships.push_back(Relationships::PEERS); break;
+            case 3: batch.recv_relationships.push_back(Relationships::CUSTOMERS); break;
+            case 4: batch.recv_relationships.push_back(Relationships::ORIGIN); break;
+            default:
+                throw std::runtime_error("Invalid recv_relationship value: " + std::to_string(rel_value));
+        }
+
+        batch.withdraws.push_back(cursor.read_bool());
+        batch.traceback_ends.push_back(cursor.read_bool());
+
+        // Communities are a bracketed, comma separated list, e.g. () or [a,b]
+        if (!cursor.at_line_end()) {
+            std::string_view communities = cursor.read_field();
+            if (communities.size() >= 2) {
+                communities = communities.substr(1, communities.size() - 2);
+            }
+            while (!communities.empty()) {
+                size_t comma = communities.find(',');
+                std::string_view community = communities.substr(0, comma);
+                if (!community.empty()) {
+                    batch.community_ids.push_back(batch.community_table.intern(std::string(community)));
+                }
+                communities = comma == std::string_view::npos ? std::string_view() : communities.substr(comma + 1);
+            }
+        }
+
+        batch.end_row();
+        cursor.next_line();
+    }
+}
+
+std::shared_ptr<AnnouncementBatch> readAnnouncementBatch(const std::string& filename, size_t num_threads = 1) {
+    // Parses an announcements TSV straight from a memory map into a batch
+    // that setup() seeds from directly. Chunks parsed in parallel are joined
+    // in file order, so the batch is the same for any number of threads
+    auto start = std::chrono::high_resolution_clock::now();
+    MappedFile file(filename);
+    const char* first = file.data();
+    const char* last = first + file.size();
+
+    std::string expectedHeaderStart = "prefix\tas_path\ttimestamp\tseed_asn\troa_valid_length\troa_origin\trecv_relationship\twithdraw\ttraceback_end\tcommunities";
+    if (!skipTSVHeader(first, last, expectedHeaderStart)) {
+        throw std::runtime_error("TSV file header does not start with the expected format.");
+    }
+
+    std::vector<const char*> chunk_starts = splitLines(first, last, num_threads);
+    std::vector<AnnouncementBatch> chunk_batches(chunk_starts.size() - 1);
+    ThreadPool thread_pool(chunk_batches.size());
+    thread_pool.parallel_for(chunk_batches.size(), [&](size_t chunk) {
+        parseAnnouncementRows(chunk_starts[chunk], chunk_starts[chunk + 1], chunk_batches[chunk]);
+    });
+
+    auto batch = std::make_shared<AnnouncementBatch>(std::move(chunk_batches[0]));
+    for (size_t chunk = 1; chunk < chunk_batches.size(); ++chunk) {
+        batch->append(chunk_batches[chunk]);
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed = end - start;
+    std::cout << "Read " << batch->size() << " announcements in "
+              << std::fixed << std::setprecision(2) << elapsed.count() << " seconds." << std::endl;
+    return batch;
+}
+
+
+
+
+
+
+///////////BGPSimple implementation. Done outside of the class to avoid circular ref with ASGraph
+void BGPSimplePolicy::process_incoming_anns(Relationships from_rel, int /*propagation_round*/, bool reset_q) {
+    process_incoming_anns_with<DecisionProcess, ImportFilter>(from_rel, reset_q);
+}
+
+template <typename Decision, typename Filter>
+void BGPSimplePolicy::process_incoming_anns_with(Relationships from_rel, bool reset_q) {
+    // Process all announcements that were incoming from a specific relationship
+
+    // Group the received announcements by prefix
+    recvQueue.sort_by_prefix();
+    const auto& received = recvQueue.prefix_anns();
+
+    // For each prefix, get all announcements received
+    size_t i = 0;
+    while (i < received.size()) {
+        uint32_t prefix_id = received[i].first;
+        size_t group_end = i;
+        while (group_end < received.size() && received[group_end].first == prefix_id) {
+            ++group_end;
+        }
+
+        counters.processed += group_end - i;
+
+        // Get announcement currently in local RIB
+        AnnID current_ann = localRIB.get_ann(prefix_id);
+
+        // Check if current announcement is seeded; if so, continue
+        if (current_ann != NO_ANN && (*ann_arena)[current_ann].seeded) {
+            i = group_end;
+            continue;
+        }
+
+        // Candidates are compared before they're copied, so only the
+        // winner for each prefix is ever allocated in the arena
+        RouteAttributes best_attributes{};
+        bool has_best = current_ann != NO_ANN;
+        if (has_best) {
+            best_attributes = rib_ann_attributes(current_ann);
+        }
+        AnnID best_received_ann = NO_ANN;
+
+        // For each announcement that was incoming
+        for (; i < group_end; ++i) {
+            AnnID new_ann = received[i].second;
+            // Make sure there are no loops and the announcement passes the filter
+            if (!Filter::accepts((*ann_arena)[new_ann])) {
+                ++counters.rejected_by_filter;
+            } else if (!valid_ann(new_ann, from_rel)) {
+                ++counters.rejected_by_loop;
+            } else {
+                RouteAttributes new_attributes = received_ann_attributes(new_ann, from_rel);
+
+                if (!has_best || Decision::prefers_new(best_attributes, new_attributes)) {
+                    best_attributes = new_attributes;
+                    has_best = true;
+                    best_received_ann = new_ann;
+                }
+            }
+        }
+
+        // This is a new best announcement. Process it and add it to the local RIB
+        if (best_received_ann != NO_ANN) {
+            // Save to local RIB
+            localRIB.add_ann(prefix_id, copy_and_process(best_received_ann, from_rel));
+            ++counters.accepted;
+        }
+    }
+
+    reset_queue(reset_q);
+}
+void BGPSimplePolicy::propagate_to_providers() {
+    std::set<Relationships> send_rels = {Relationships::ORIGIN, Relationships::CUSTOMERS};
+    propagate(Relationships::PROVIDERS, send_rels);
+}
+
+void BGPSimplePolicy::propagate_to_customers() {
+    std::set<Relationships> send_rels = {Relationships::ORIGIN, Relationships::CUSTOMERS, Relationships::PEERS, Relationships::PROVIDERS};
+    propagate(Relationships::CUSTOMERS, send_rels);
+}
+
+void BGPSimplePolicy::propagate_to_peers() {
+    std::set<Relationships> send_rels = {Relationships::ORIGIN, Relationships::CUSTOMERS};
+    propagate(Relationships::PEERS, send_rels);
+}
+
+void BGPSimplePolicy::receive_ann(uint32_t prefix_id, AnnID ann_id) {
+    recvQueue.add_ann(prefix_id, ann_id);
+}
+
+void BGPSimplePolicy::receive_anns(const std::vector<RecvQueue::entry_type>& entries) {
+    recvQueue.add_anns(entries);
+}
+
+bool BGPSimplePolicy::valid_ann(AnnID ann_id, Relationships recv_relationship) const {
+    // BGP Loop Prevention Check
+    return !ann_arena->as_paths().contains((*ann_arena)[ann_id].as_path, as_graph->asns[as_index]);
+}
+AnnID BGPSimplePolicy::copy_and_process(AnnID ann_id, Relationships recv_relationship) {
+    // Arena chunks never move, so this stays valid across add()
+    const Ann& ann = (*ann_arena)[ann_id];
+
+    // Return a new Ann with the modified AS path and recv_relationship
+    // The path shares every node of the received one; only our ASN is added
+    return ann_arena->add({
+        ann.prefix_id,
+        ann_arena->as_paths().prepend(ann.as_path, as_graph->asns[as_index]),
+        ann.seed_index,
+        recv_relationship,
+        false,
+        ann.invalid_by_roa
+    });
+}
+
+void BGPSimplePolicy::reset_queue(bool reset_q) {
+    if (reset_q) {
+        // Empty the recvQueue, keeping its buffer unless it grew large
+        recvQueue.clear();
+    }
+}
+
+RouteAttributes BGPSimplePolicy::rib_ann_attributes(AnnID ann_id) const {
+    // Attributes of an announcement already processed by this AS
+    const Ann& ann = (*ann_arena)[ann_id];
+    const ASPathStore& as_paths = ann_arena->as_paths();
+    const ASPathNode& first = as_paths.node(ann.as_path);
+    if (first.length == 0) {
+        throw std::runtime_error("Invalid announcement or empty AS path in rib_ann_attributes.");
+    }
+    int neighbor_asn = first.length > 1 ? as_paths.node(first.parent).asn : first.asn;
+    return {ann.recv_relationship, first.length, neighbor_asn};
+}
+
+RouteAttributes BGPSimplePolicy::received_ann_attributes(AnnID ann_id, Relationships recv_relationship) const {
+    // Attributes the announcement would have after copy_and_process, without copying it
+    const ASPathNode& first = ann_arena->as_paths().node((*ann_arena)[ann_id].as_path);
+    if (first.length == 0) {
+        throw std::runtime_error("Invalid announcement or empty AS path in received_ann_attributes.");
+    }
+    return {recv_relationship, first.length + 1, first.asn};
+}
+
+
+///////////////////////////////// propagate
+thread_local std::vector<RecvQueue::entry_type> BGPSimplePolicy::outgoing_anns;
+thread_local std::vector<RecvQueue::entry_type> BGPSimplePolicy::pending_anns;
+thread_local std::vector<uint32_t> BGPSimplePolicy::pending_prefix_ids;
+
+void BGPSimplePolicy::propagate(Relationships propagate_to, const std::set<Relationships>& send_rels) {
+    // A view into the graph's adjacency arrays; nothing is copied
+    ASIndexRange neighbors = as_graph->neighbors(as_index, propagate_to);
+
+    if (!neighbors.empty()) {
+        collect_pending_anns(propagate_to, send_rels);
+        for (uint32_t neighbor_index : neighbors) {
+            if (neighbor_policies->is_lazy(neighbor_index)) {
+                continue;
+            }
+            outgoing_anns.clear();
+            for (const auto& [prefix_id, ann_id] : pending_anns) {
+                if (policy_propagate(neighbor_index, ann_id, propagate_to, send_rels)) {
+                    continue;
+                } else {
+                    process_outgoing_ann(neighbor_index, ann_id, propagate_to, send_rels);
+                }
+            }
+            // Delivered in one go so the neighbor's queue is locked once
+            if (!outgoing_anns.empty()) {
+                (*neighbor_policies)[neighbor_index].receive_anns(outgoing_anns);
+            }
+        }
+    }
+    localRIB.advance_watermark(propagate_to);
+}
+
+void BGPSimplePolicy::collect_pending_anns(Relationships propagate_to, const std::set<Relationships>& send_rels) {
+    // Fills pending_anns with the entries that changed since this AS last
+    // sent to propagate_to, in prefix ID order. Anything older was already
+    // sent, and a neighbor's RIB entry is never worse than what it was
+    // sent, so sending it again could not change the neighbor's choice
+    const auto& changes = localRIB.changes();
+    pending_prefix_ids.assign(changes.begin() + localRIB.watermark(propagate_to), changes.end());
+    // Each batch of changes is appended in prefix order, so this is
+    // usually sorted already
+    if (!std::is_sorted(pending_prefix_ids.begin(), pending_prefix_ids.end())) {
+        std::sort(pending_prefix_ids.begin(), pending_prefix_ids.end());
+    }
+    pending_prefix_ids.erase(std::unique(pending_prefix_ids.begin(), pending_prefix_ids.end()), pending_prefix_ids.end());
+
+    pending_anns.clear();
+    for (uint32_t prefix_id : pending_prefix_ids) {
+        AnnID ann_id = localRIB.get_ann(prefix_id);
+        if (ann_id != NO_ANN && send_rels.find((*ann_arena)[ann_id].recv_relationship) != send_rels.end()) {
+            pending_anns.emplace_back(prefix_id, ann_id);
+        }
+    }
+}
+
+bool BGPSimplePolicy::policy_propagate(uint32_t neighbor_index, AnnID ann_id, Relationships propagate_to, const std::set<Relationships>& send_rels) {
+    // This method simply returns false and does not use the neighbor
+    return false;
+}
+
+void BGPSimplePolicy::process_outgoing_ann(uint32_t /*neighbor_index*/, AnnID ann_id, Relationships propagate_to, const std::set<Relationships>& send_rels) {
+    // Only the handle is sent; the neighbor copies it if it selects it.
+    // propagate() delivers the batch once every announcement is processed
+    outgoing_anns.emplace_back((*ann_arena)[ann_id].prefix_id, ann_id);
+}
+
+///////////ROVSimple implementation
+void ROVSimplePolicy::process_incoming_anns(Relationships from_rel, int /*propagation_round*/, bool reset_q) {
+    process_incoming_anns_with<DecisionProcess, ImportFilter>(from_rel, reset_q);
+}
+
+
+// Local RIB entries of a list of ASes by column, ordered by AS and then by
+// prefix ID. Entries of the i-th AS are rows [as_offsets[i], as_offsets[i + 1])
+// and the path of row r is path_asns[path_offsets[r], path_offsets[r + 1]),
+// first hop first
+struct RIBColumns {
+    std::vector<uint64_t> as_offsets;
+    std::vector<int32_t> asns;
+    std::vector<uint32_t> prefix_ids;
+    std::vector<uint8_t> recv_relationships;
+    std::vector<int32_t> timestamps;
+    std::vector<uint64_t> path_offsets;
+    std::vector<int32_t> path_asns;
+};
+
+
+// Counted memory of one MemoryCategory, or of all of them as "total"
+struct MemoryUsage {
+    std::string category;
+    int64_t bytes;
+    // Element slots allocated, e.g. a vector's capacity
+    int64_t objects;
+    int64_t peak_bytes;
+};
+
+
+// What CPPSimulationEngine::memory_report returns
+struct MemoryReport {
+    // Every category in MemoryCategory order, then the total
+    std::vector<MemoryUsage> usage;
+    // Highest bytes of every category, and "total", during each phase
+    MemoryPhase::PeakBytes phase_peak_bytes;
+};
+
+
+// Wall time of one propagation rank, index 0 being the ASes without customers
+struct RankMetrics {
+    size_t num_ases = 0;
+    // Processing what customers sent and sending to providers
+    double providers_seconds = 0;
+    // Processing what providers sent and sending to customers
+    double customers_seconds = 0;
+};
+
+
+// What CPPSimulationEngine::get_metrics returns; filled in by every run()
+struct RunMetrics {
+    int propagation_round = -1;
+    size_t num_threads = 0;
+    std::string propagation_mode;
+    double seconds = 0;
+    // Phase and rank times are only measured in RANK_PARALLEL mode, since
+    // prefix shards go through the phases concurrently
+    double providers_seconds = 0;
+    double peers_seconds = 0;
+    double customers_seconds = 0;
+    std::vector<RankMetrics> ranks;
+    // Summed over every AS; see PolicyCounters
+    uint64_t anns_received = 0;
+    uint64_t anns_processed = 0;
+    uint64_t anns_accepted = 0;
+    uint64_t anns_rejected_by_loop = 0;
+    uint64_t anns_rejected_by_filter = 0;
+    // Largest receive queue of the run, and whose it was
+    size_t recv_queue_peak = 0;
+    int recv_queue_peak_asn = -1;
+
+    std::string to_json() const {
+        std::ostringstream out;
+        out << std::setprecision(9);
+        out << "{\"propagation_round\": " << propagation_round
+            << ", \"num_threads\": " << num_threads
+            << ", \"propagation_mode\": \"" << propagation_mode << "\""
+            << ", \"seconds\": " << seconds
+            << ", \"phases\": {\"providers\": " << providers_seconds
+            << ", \"peers\": " << peers_seconds
+            << ", \"customers\": " << customers_seconds << "}"
+            << ", \"ranks\": [";
+        for (size_t i = 0; i < ranks.size(); ++i) {
+            out << (i > 0 ? ", " : "") << "{\"num_ases\": " << ranks[i].num_ases
+                << ", \"providers_seconds\": " << ranks[i].providers_seconds
+                << ", \"customers_seconds\": " << ranks[i].customers_seconds << "}";
+        }
+        out << "], \"anns_received\": " << anns_received
+            << ", \"anns_processed\": " << anns_processed
+            << ", \"anns_accepted\": " << anns_accepted
+            << ", \"anns_rejected_by_loop\": " << anns_rejected_by_loop
+            << ", \"anns_rejected_by_filter\": " << anns_rejected_by_filter
+            << ", \"recv_queue_peak\": " << recv_queue_peak
+            << ", \"recv_queue_peak_asn\": " << recv_queue_peak_asn << "}";
+        return out.str();
+    }
+};
+
+
+// The route picked for (AS, prefix) pairs, one element per pair. A pair
+// with no announcement has next hop and origin -1, path length 0 and
+// recv_relationship 0
+struct RouteColumns {
+    // The neighbor the route was learned from; the AS itself if seeded there
+    std::vector<int32_t> next_hops;
+    std::vector<int32_t> origins;
+    std::vector<uint32_t> path_lengths;
+    std::vector<uint8_t> recv_relationships;
+
+    explicit RouteColumns(size_t size = 0)
+        : next_hops(size, -1), origins(size, -1), path_lengths(size, 0), recv_relationships(size, 0) {}
+};
+
+
+// RouteColumns for every prefix of a list of ASes, as row major matrices
+// with one row per AS and one column per prefix ID
+struct RIBMatrices {
+    std::vector<int32_t> asns;
+    size_t num_prefixes;
+    RouteColumns routes;
+
+    RIBMatrices(std::vector<int32_t> asns, size_t num_prefixes)
+        : asns(std::move(asns)), num_prefixes(num_prefixes), routes(this->asns.size() * num_prefixes) {}
+};
+
+
+// One trial of CPPSimulationEngine::run_batch, with the arguments of setup()
+struct Scenario {
+    std::shared_ptr<const AnnouncementBatch> announcements;
+    std::string base_policy_class_str = "BGPSimplePolicy";
+    std::map<int, std::string> non_default_asn_cls_str_dict;
+    LocalRIBBackend local_rib_backend = LocalRIBBackend::AUTO;
+};
+
+
+class CPPSimulationEngine {
+public:
+    // Topology only; never modified, so engines can share one graph
+    std::shared_ptr<const ASGraph> as_graph;
+    // Routing state of this engine's scenario, one policy per AS of the
+    // graph. Behind a pointer since policies refer to the set they're in
+    std::unique_ptr<PolicySet> policies;
+    int ready_to_run_round;
+    // Built once per setup(); maps every seeded prefix to a dense ID
+    PrefixTable prefix_table;
+    // Every announcement and AS path created by this engine's run. Behind a
+    // pointer so policies can keep referring to it when the engine is moved
+    std::unique_ptr<AnnouncementArena> ann_arena;
+    // The announcements passed to setup(), indexed by Ann::seed_index
+    std::shared_ptr<const AnnouncementBatch> seed_batch;
+    // Workers that process the ASes of a propagation rank, or whole prefix
+    // shards, in parallel
+    std::unique_ptr<ThreadPool> thread_pool;
+    // Print progress and timings. Off for the engines run_batch uses
+    bool verbose = true;
+    // Record per phase memory peaks for memory_report(). Off for the
+    // engines run_batch uses, whose phases overlap
+    bool record_memory_phases = true;
+    // Peak bytes per category during each phase; see memory_report()
+    MemoryPhase::PeakBytes phase_peak_bytes;
+    // Timings and counts of the last run(); see get_metrics()
+    RunMetrics metrics;
+    // Read by setup(). When set, stubs (ASes without customers) that aren't
+    // seeded anything are left out of propagation: their choice never
+    // reaches another AS, so their routes are only computed, from what
+    // their peers and providers ended up with, once results are asked for
+    bool lazy_stubs = false;
+
+
+    // Engines made from the same graph share it
+    CPPSimulationEngine(std::shared_ptr<const ASGraph> as_graph, int ready_to_run_round = -1)
+        : as_graph(std::move(as_graph)), policies(std::make_unique<PolicySet>()), ready_to_run_round(ready_to_run_round),
+          ann_arena(std::make_unique<AnnouncementArena>()) {
+
+        register_policies();  // Register policy types upon construction
+    }
+
+    // Disable copy semantics
+    CPPSimulationEngine(const CPPSimulationEngine&) = delete;
+    CPPSimulationEngine& operator=(const CPPSimulationEngine&) = delete;
+
+    // Enable move semantics
+    CPPSimulationEngine(CPPSimulationEngine&&) = default;
+    CPPSimulationEngine& operator=(CPPSimulationEngine&&) = default;
+
+
+    void setup(const std::vector<std::shared_ptr<Announcement>>& announcements,
+               const std::string& base_policy_class_str = "BGPSimplePolicy",
+               const std::map<int, std::string>& non_default_asn_cls_str_dict = {},
+               LocalRIBBackend local_rib_backend = LocalRIBBackend::AUTO) {
+        setup(AnnouncementBatch::from_announcements(announcements), base_policy_class_str,
+              non_default_asn_cls_str_dict, local_rib_backend);
+    }
+
+    void setup_from_arrays(const AnnouncementArrays& announcements,
+                           const std::string& base_policy_class_str = "BGPSimplePolicy",
+                           const std::map<int, std::string>& non_default_asn_cls_str_dict = {},
+                           LocalRIBBackend local_rib_backend = LocalRIBBackend::AUTO) {
+        setup(AnnouncementBatch::from_arrays(announcements), base_policy_class_str,
+              non_default_asn_cls_str_dict, local_rib_backend);
+    }
+
+    void setup(std::shared_ptr<const AnnouncementBatch> announcements,
+               const std::string& base_policy_class_str = "BGPSimplePolicy",
+               const std::map<int, std::string>& non_default_asn_cls_str_dict = {},
+               LocalRIBBackend local_rib_backend = LocalRIBBackend::AUTO) {
+        MemoryPhase memory_phase(phase_peak_bytes, "setup", record_memory_phases);
+        if (verbose) {
+            std::cout<<"in here"<<std::endl;
+        }
+        if (!announcements) {
+            throw std::runtime_error("Announcement batch is null.");
+        }
+        set_as_classes(base_policy_class_str, non_default_asn_cls_str_dict);
+
+        if (verbose) {
+            std::cout<<"here"<<std::endl;
+        }
+        // Policies kept from a previous setup may still hold its results
+        reset_policies();
+        // The batch already interned its prefixes in order of first appearance
+        prefix_table = announcements->prefix_table;
+        // Everything from a previous setup is freed at once
+        ann_arena->reset();
+        configure_local_ribs(local_rib_backend);
+        seed_announcements(std::move(announcements));
+        mark_lazy_stubs();
+
+        if (verbose) {
+            std::cout<<"out here"<<std::endl;
+        }
+        ready_to_run_round = 0;
+    }
+
+    void reset() {
+        // Clears everything setup() and run() produced so the engine can be
+        // set up for another trial. The graph, the policies (reused by the
+        // next setup() if every AS keeps its class) and all allocated
+        // storage are kept; only RIBs and queues that hold state are touched
+        reset_policies();
+        policies->lazy_states.clear();
+        policies->materialized.clear();
+        ann_arena->reset();
+        seed_batch.reset();
+        prefix_table = PrefixTable();
+        ready_to_run_round = -1;
+    }
+
+    void run(int propagation_round = 0, size_t num_threads = 1,
+             PropagationMode propagation_mode = PropagationMode::RANK_PARALLEL) {
+
+        auto start = std::chrono::high_resolution_clock::now();
+        // Ensure that the simulator is ready to run this round
+        if (ready_to_run_round != propagation_round) {
+            throw std::runtime_error("Engine not set up to run for round " + std::to_string(propagation_round));
+        }
+        MemoryPhase memory_phase(phase_peak_bytes, "run", record_memory_phases);
+        // The calling thread does its share of the work as worker 0
+        WorkerSlotGuard worker_slot_guard(0);
+        set_num_threads(num_threads);
+        // Routes computed for lazy stubs after the last round are outdated
+        invalidate_lazy_stubs();
+        reset_metrics(propagation_round, propagation_mode);
+
+        // Propagate announcements
+        if (propagation_mode == PropagationMode::PREFIX_SHARDED) {
+            propagate_prefix_sharded(propagation_round);
+        } else {
+            propagate(*policies, propagation_round, true, &metrics);
+            add_metrics(*policies);
+        }
+
+        // Increment the ready to run round
+        ready_to_run_round++;
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> elapsed = end - start;
+        metrics.seconds = elapsed.count();
+        if (verbose) {
+            std::cout << "Propagated in "
+                      << std::fixed << std::setprecision(2) << elapsed.count() << " seconds." << std::endl;
+        }
+
+    }
+
+    void update_policies(const std::map<int, std::string>& asn_cls_str_dict) {
+        // Gives the ASes in asn_cls_str_dict a new policy class after run()
+        // and updates the local RIBs to what a full run with the new classes
+        // would give. Only routes that can change are recomputed; see
+        // repropagate()
+        auto start = std::chrono::high_resolution_clock::now();
+        if (ready_to_run_round <= 0) {
+            throw std::runtime_error("Engine must have run before its policies can be updated.");
+        }
+        MemoryPhase memory_phase(phase_peak_bytes, "update", record_memory_phases);
+        std::vector<std::vector<uint32_t>> changed_prefixes(as_graph->size());
+        std::vector<uint32_t> all_prefix_ids(prefix_table.size());
+        std::iota(all_prefix_ids.begin(), all_prefix_ids.end(), 0);
+        // Every entry is checked before anything changes, so a bad one
+        // leaves the engine as it was
+        std::vector<std::pair<uint32_t, const PolicyClass*>> new_classes;
+        for (const auto& [asn, policy_class_str] : asn_cls_str_dict) {
+            uint32_t as_index = as_graph->get_index(asn);
+            if (as_index == NO_AS_INDEX) {
+                throw std::runtime_error("AS object not found in ASGraph.");
+            }
+            auto class_it = name_to_policy_class_dict.find(policy_class_str);
+            if (class_it == name_to_policy_class_dict.end()) {
+                throw std::runtime_error("Policy class not implemented: " + policy_class_str);
+            }
+            new_classes.emplace_back(as_index, &class_it->second);
+        }
+        size_t num_changed = 0;
+        for (const auto& [as_index, policy_class] : new_classes) {
+            if (as_policy_classes[as_index] != policy_class) {
+                as_policy_classes[as_index] = policy_class;
+                // A new policy may accept or prefer anything
+                changed_prefixes[as_index] = all_prefix_ids;
+                ++num_changed;
+            }
+        }
+        if (num_changed == 0) {
+            return;
+        }
+
+        // New policies take over the local RIBs of the old ones
+        auto new_policies = std::make_unique<PolicySet>();
+        build_policy_set(*new_policies);
+        for (uint32_t as_index = 0; as_index < as_graph->size(); ++as_index) {
+            (*new_policies)[as_index].localRIB = std::move((*policies)[as_index].localRIB);
+        }
+        new_policies->lazy_states = std::move(policies->lazy_states);
+        new_policies->materialized = std::move(policies->materialized);
+        policies = std::move(new_policies);
+
+        WorkerSlotGuard worker_slot_guard(0);
+        size_t num_recomputed = repropagate(std::move(changed_prefixes));
+
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> elapsed = end - start;
+        if (verbose) {
+            std::cout << "Updated " << num_changed << " policies, recomputing " << num_recomputed << " routes in "
+                      << std::fixed << std::setprecision(2) << elapsed.count() << " seconds." << std::endl;
+        }
+    }
+
+    void withdraw(const std::vector<std::pair<int, std::string>>& seeds) {
+        // Withdraws the announcements seeded at (ASN, prefix) pairs from a
+        // converged engine. Only the routes that derived from them, or can
+        // now be replaced by one, are recomputed; every AS re-selects from
+        // what its neighbors still send
+        auto start = std::chrono::high_resolution_clock::now();
+        if (ready_to_run_round <= 0) {
+            throw std::runtime_error("Engine must have run before announcements can be withdrawn.");
+        }
+        MemoryPhase memory_phase(phase_peak_bytes, "update", record_memory_phases);
+        std::vector<std::vector<uint32_t>> changed_prefixes(as_graph->size());
+        std::unordered_map<uint64_t, AnnID> old_routes;
+        for (const auto& [asn, prefix] : seeds) {
+            uint32_t as_index = as_graph->get_index(asn);
+            if (as_index == NO_AS_INDEX) {
+                throw std::runtime_error("AS object not found in ASGraph.");
+            }
+            std::optional<uint32_t> prefix_id = prefix_table.get_id(prefix);
+            const LocalRIB& rib = (*policies)[as_index].localRIB;
+            AnnID ann_id = prefix_id ? rib.get_ann(*prefix_id) : NO_ANN;
+            if (ann_id == NO_ANN || !(*ann_arena)[ann_id].seeded) {
+                throw std::runtime_error("No announcement for " + prefix + " is seeded at AS " + std::to_string(asn) + ".");
+            }
+            // Pairs given twice are withdrawn once
+            if (old_routes.emplace(route_key(as_index, *prefix_id), ann_id).second) {
+                changed_prefixes[as_index].push_back(*prefix_id);
+            }
+        }
+        // Nothing is removed until every pair is checked, so a bad one
+        // leaves the engine as it was
+        size_t num_withdrawn = old_routes.size();
+        for (uint32_t as_index = 0; as_index < as_graph->size(); ++as_index) {
+            for (uint32_t prefix_id : changed_prefixes[as_index]) {
+                (*policies)[as_index].localRIB.remove_ann(prefix_id);
+            }
+        }
+
+        WorkerSlotGuard worker_slot_guard(0);
+        size_t num_recomputed = repropagate(std::move(changed_prefixes), std::move(old_routes));
+
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> elapsed = end - start;
+        if (verbose) {
+            std::cout << "Withdrew " << num_withdrawn << " announcements, recomputing " << num_recomputed << " routes in "
+                      << std::fixed << std::setprecision(2) << elapsed.count() << " seconds." << std::endl;
+        }
+    }
+
+    void withdraw(const AnnouncementBatch& announcements) {
+        // Withdraws the seeded announcement each row flagged withdraw refers to
+        std::vector<std::pair<int, std::string>> seeds;
+        for (size_t row = 0; row < announcements.size(); ++row) {
+            if (!announcements.withdraws[row]) {
+                continue;
+            }
+            if (!announcements.seed_asns[row].has_value()) {
+                throw std::runtime_error("Withdrawal seed ASN is not set.");
+            }
+            seeds.emplace_back(announcements.seed_asns[row].value(),
+                               announcements.prefix_table.get_prefix(announcements.prefix_ids[row]));
+        }
+        withdraw(seeds);
+    }
+
+    std::shared_ptr<Announcement> get_announcement(AnnID ann_id) const {
+        // Materializes an Ann as an Announcement for Python
+        const Ann& ann = (*ann_arena)[ann_id];
+        const AnnouncementBatch& batch = *seed_batch;
+        uint32_t row = ann.seed_index;
+        return make_announcement(
+            prefix_table.get_prefix(ann.prefix_id),
+            ASPath(ann_arena->as_path_store(), ann.as_path),
+            batch.timestamps[row],
+            ann.seeded ? batch.seed_asns[row] : std::nullopt,
+            batch.roa_valid_lengths[row],
+            batch.roa_origins[row],
+            ann.recv_relationship,
+            batch.withdraws[row],
+            batch.traceback_ends[row],
+            batch.communities(row),
+            ann.prefix_id
+        );
+    }
+
+    std::map<std::string, std::shared_ptr<Announcement>> get_local_rib(int asn) {
+        // Returns the local RIB of an AS keyed by prefix
+        uint32_t as_index = as_graph->get_index(asn);
+        if (as_index == NO_AS_INDEX) {
+            throw std::runtime_error("AS object not found in ASGraph.");
+        }
+        MemoryPhase memory_phase(phase_peak_bytes, "results", record_memory_phases);
+        WorkerSlotGuard worker_slot_guard(0);
+        materialize_lazy_stub(as_index);
+        std::map<std::string, std::shared_ptr<Announcement>> local_rib;
+        for (const auto& [prefix_id, ann_id] : (*policies)[as_index].localRIB.prefix_anns()) {
+            local_rib.emplace(prefix_table.get_prefix(prefix_id), get_announcement(ann_id));
+        }
+        return local_rib;
+    }
+
+    void dump_local_ribs(const std::string& path, const std::optional<std::vector<int>>& asns = std::nullopt,
+                         RIBDumpFormat format = RIBDumpFormat::TSV, size_t num_threads = 1) {
+        // Writes the local RIBs of asns (every AS, in graph order, by
+        // default) to path. Entries of an AS are in prefix ID order. Rows
+        // are formatted in parallel and written in order in large blocks
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<uint32_t> as_indices = get_result_as_indices(asns);
+        MemoryPhase memory_phase(phase_peak_bytes, "results", record_memory_phases);
+        WorkerSlotGuard worker_slot_guard(0);
+        set_num_threads(num_threads);
+        materialize_lazy_stubs(as_indices);
+        size_t num_rows = format == RIBDumpFormat::BINARY ? dump_local_ribs_binary(path, as_indices)
+                                                          : dump_local_ribs_tsv(path, as_indices);
+
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> elapsed = end - start;
+        if (verbose) {
+            std::cout << "Dumped " << num_rows << " local RIB entries in "
+                      << std::fixed << std::setprecision(2) << elapsed.count() << " seconds." << std::endl;
+        }
+    }
+
+    std::shared_ptr<RIBColumns> get_rib_columns(const std::optional<std::vector<int>>& asns = std::nullopt,
+                                                size_t num_threads = 1) {
+        // Local RIBs of asns (every AS, in graph order, by default) by column
+        std::vector<uint32_t> as_indices = get_result_as_indices(asns);
+        MemoryPhase memory_phase(phase_peak_bytes, "results", record_memory_phases);
+        WorkerSlotGuard worker_slot_guard(0);
+        set_num_threads(num_threads);
+        materialize_lazy_stubs(as_indices);
+        return collect_rib_columns(as_indices);
+    }
+
+    std::shared_ptr<RIBMatrices> get_rib_matrices(const std::optional<std::vector<int>>& asns = std::nullopt,
+                                                  size_t num_threads = 1) {
+        // Route of asns (every AS, in graph order, by default) for every prefix
+        std::vector<uint32_t> as_indices = get_result_as_indices(asns);
+        MemoryPhase memory_phase(phase_peak_bytes, "results", record_memory_phases);
+        WorkerSlotGuard worker_slot_guard(0);
+        set_num_threads(num_threads);
+        materialize_lazy_stubs(as_indices);
+
+        std::vector<int32_t> row_asns;
+        for (uint32_t as_index : as_indices) {
+            row_asns.push_back(as_graph->asns[as_index]);
+        }
+        auto matrices = std::make_shared<RIBMatrices>(std::move(row_asns), prefix_table.size());
+        for_each_index(as_indices.size(), true, [&](size_t row) {
+            for (const auto& [prefix_id, ann_id] : (*policies)[as_indices[row]].localRIB.prefix_anns()) {
+                set_route(matrices->routes, row * matrices->num_prefixes + prefix_id, ann_id);
+            }
+        });
+        return matrices;
+    }
+
+    std::vector<std::shared_ptr<RIBColumns>> run_batch(const std::vector<Scenario>& scenarios, size_t num_threads = 1,
+                                                       const std::optional<std::vector<int>>& asns = std::nullopt) {
+        // Runs every scenario for round 0 against this engine's graph and
+        // returns the local RIBs of asns (every AS by default) after each.
+        // Each thread has its own engine that shares the graph and is reset
+        // between scenarios, so memory grows with threads, not scenarios.
+        // This engine's own state is left untouched
+        auto start = std::chrono::high_resolution_clock::now();
+        ThreadPool scenario_pool(std::min(std::max<size_t>(num_threads, 1), std::max<size_t>(scenarios.size(), 1)));
+        std::vector<std::unique_ptr<CPPSimulationEngine>> engines(scenario_pool.size());
+        std::vector<std::shared_ptr<RIBColumns>> results(scenarios.size());
+        MemoryPhase memory_phase(phase_peak_bytes, "run_batch", record_memory_phases);
+        WorkerSlotGuard worker_slot_guard(0);
+        scenario_pool.parallel_for(scenarios.size(), [&](size_t i) {
+            auto& engine = engines[current_worker_slot()];
+            // The engine is single threaded, so its own worker 0
+            WorkerSlotGuard engine_slot_guard(0);
+            if (!engine) {
+                engine = std::make_unique<CPPSimulationEngine>(as_graph);
+                engine->verbose = false;
+                engine->lazy_stubs = lazy_stubs;
+                engine->record_memory_phases = false;
+                engine->name_to_policy_class_dict = name_to_policy_class_dict;
+            }
+            const Scenario& scenario = scenarios[i];
+            engine->setup(scenario.announcements, scenario.base_policy_class_str,
+                          scenario.non_default_asn_cls_str_dict, scenario.local_rib_backend);
+            engine->run(0, 1);
+            results[i] = engine->get_rib_columns(asns, 1);
+            engine->reset();
+        });
+
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> elapsed = end - start;
+        if (verbose) {
+            std::cout << "Ran " << scenarios.size() << " scenarios in "
+                      << std::fixed << std::setprecision(2) << elapsed.count() << " seconds." << std::endl;
+        }
+        return results;
+    }
+
+    RouteColumns lookup_routes(const int32_t* asns, const uint32_t* prefix_ids, size_t size) {
+        // Route of AS asns[i] for prefix ID prefix_ids[i], for each i
+        if (!seed_batch) {
+            throw std::runtime_error("Engine has not been set up.");
+        }
+        MemoryPhase memory_phase(phase_peak_bytes, "results", record_memory_phases);
+        WorkerSlotGuard worker_slot_guard(0);
+        RouteColumns routes(size);
+        for (size_t i = 0; i < size; ++i) {
+            uint32_t as_index = as_graph->get_index(asns[i]);
+            if (as_index == NO_AS_INDEX) {
+                throw std::runtime_error("AS object not found in ASGraph.");
+            }
+            if (prefix_ids[i] >= prefix_table.size()) {
+                throw std::runtime_error("Prefix ID not in prefix table.");
+            }
+            materialize_lazy_stub(as_index);
+            AnnID ann_id = (*policies)[as_index].localRIB.get_ann(prefix_ids[i]);
+            if (ann_id != NO_ANN) {
+                set_route(routes, i, ann_id);
+            }
+        }
+        return routes;
+    }
+
+    MemoryReport memory_report() const {
+        // Live and peak bytes of every memory category, counted exactly by
+        // the allocators. Counts cover the whole process, so they include
+        // every engine and batch alive; the phase peaks are this engine's
+        MemoryReport report;
+        for (size_t i = 0; i < NUM_MEMORY_CATEGORIES; ++i) {
+            auto category = static_cast<MemoryCategory>(i);
+            MemoryCounters::Usage usage = MemoryCounters::usage(category);
+            report.usage.push_back({memory_category_name(category), usage.bytes, usage.objects, usage.peak_bytes});
+        }
+        MemoryCounters::Usage total = MemoryCounters::total_usage();
+        report.usage.push_back({"total", total.bytes, total.objects, total.peak_bytes});
+        report.phase_peak_bytes = phase_peak_bytes;
+        return report;
+    }
+
+    const RunMetrics& get_metrics() const {
+        return metrics;
+    }
+
+    void write_metrics(const std::string& path) const {
+        // Writes get_metrics() as a single JSON object
+        std::ofstream file(path);
+        if (!file) {
+            throw std::runtime_error("Could not open file for writing: " + path);
+        }
+        file << metrics.to_json() << "\n";
+    }
+
+    std::vector<std::shared_ptr<Announcement>> get_announcements_from_tsv(const std::string& path) {
+        return readAnnouncementBatch(path)->to_announcements();
+    }
+
+protected:
+
+    ///////////////////////result funcs
+
+    std::vector<uint32_t> get_result_as_indices(const std::optional<std::vector<int>>& asns) const {
+        // Indices of asns, or of every AS in graph order
+        if (!seed_batch) {
+            throw std::runtime_error("Engine has not been set up.");
+        }
+        std::vector<uint32_t> as_indices;
+        if (asns) {
+            for (int asn : *asns) {
+                uint32_t as_index = as_graph->get_index(asn);
+                if (as_index == NO_AS_INDEX) {
+                    throw std::runtime_error("AS object not found in ASGraph.");
+                }
+                as_indices.push_back(as_index);
             }
+        } else {
+            as_indices.resize(as_graph->size());
+            std::iota(as_indices.begin(), as_indices.end(), 0);
         }
-        throw std::runtime_error("No announcement was chosen.");
+        return as_indices;
     }
-}
 
-std::shared_ptr<Announcement> BGPSimplePolicy::get_best_ann_by_local_pref(const std::shared_ptr<Announcement>& current_ann, const std::shared_ptr<Announcement>& new_ann) {
-    if (!current_ann || !new_ann) {
-        throw std::runtime_error("Announcement is null in get_best_ann_by_local_pref.");
+    void set_route(RouteColumns& routes, size_t i, AnnID ann_id) const {
+        // Next hop is the neighbor ASN that the decision process compares
+        const Ann& ann = (*ann_arena)[ann_id];
+        const ASPathStore& as_paths = ann_arena->as_paths();
+        const ASPathNode& first = as_paths.node(ann.as_path);
+        ASPathID origin = ann.as_path;
+        while (as_paths.node(origin).length > 1) {
+            origin = as_paths.node(origin).parent;
+        }
+        routes.next_hops[i] = first.length > 1 && !ann.seeded ? as_paths.node(first.parent).asn : first.asn;
+        routes.origins[i] = first.length > 0 ? as_paths.node(origin).asn : -1;
+        routes.path_lengths[i] = first.length;
+        routes.recv_relationships[i] = static_cast<uint8_t>(ann.recv_relationship);
     }
 
-    if (current_ann->recv_relationship > new_ann->recv_relationship) {
-        return current_ann;
-    } else if (current_ann->recv_relationship < new_ann->recv_relationship) {
-        return new_ann;
-    } else {
-        return nullptr;
+    std::shared_ptr<RIBColumns> collect_rib_columns(const std::vector<uint32_t>& as_indices) {
+        // Fills the row columns in parallel per AS, then the paths once
+        // their offsets are known
+        auto columns = std::make_shared<RIBColumns>();
+        columns->as_offsets.assign(as_indices.size() + 1, 0);
+        for (size_t i = 0; i < as_indices.size(); ++i) {
+            columns->as_offsets[i + 1] = columns->as_offsets[i] + (*policies)[as_indices[i]].localRIB.size();
+        }
+        size_t num_rows = columns->as_offsets.back();
+
+        columns->asns.resize(num_rows);
+        columns->prefix_ids.resize(num_rows);
+        columns->recv_relationships.resize(num_rows);
+        columns->timestamps.resize(num_rows);
+        columns->path_offsets.assign(num_rows + 1, 0);
+        const ASPathStore& as_paths = ann_arena->as_paths();
+        for_each_index(as_indices.size(), true, [&](size_t i) {
+            uint64_t row = columns->as_offsets[i];
+            for (const auto& [prefix_id, ann_id] : (*policies)[as_indices[i]].localRIB.prefix_anns()) {
+                const Ann& ann = (*ann_arena)[ann_id];
+                columns->asns[row] = as_graph->asns[as_indices[i]];
+                columns->prefix_ids[row] = prefix_id;
+                columns->recv_relationships[row] = static_cast<uint8_t>(ann.recv_relationship);
+                columns->timestamps[row] = seed_batch->timestamps[ann.seed_index];
+                // Lengths for now; turned into offsets below
+                columns->path_offsets[row + 1] = as_paths.length(ann.as_path);
+                ++row;
+            }
+        });
+        std::partial_sum(columns->path_offsets.begin(), columns->path_offsets.end(), columns->path_offsets.begin());
+
+        columns->path_asns.resize(columns->path_offsets.back());
+        for_each_index(as_indices.size(), true, [&](size_t i) {
+            uint64_t row = columns->as_offsets[i];
+            for (const auto& [prefix_id, ann_id] : (*policies)[as_indices[i]].localRIB.prefix_anns()) {
+                uint64_t pos = columns->path_offsets[row];
+                for (ASPathID path_id = (*ann_arena)[ann_id].as_path; path_id != EMPTY_AS_PATH; path_id = as_paths.node(path_id).parent) {
+                    columns->path_asns[pos++] = as_paths.node(path_id).asn;
+                }
+                ++row;
+            }
+        });
+        return columns;
     }
-}
 
-std::shared_ptr<Announcement> BGPSimplePolicy::get_best_ann_by_as_path(const std::shared_ptr<Announcement>& current_ann, const std::shared_ptr<Announcement>& new_ann) {
-    if (!current_ann || !new_ann) {
-        throw std::runtime_error("Announcement is null in get_best_ann_by_as_path.");
+    ///////////////////////dump funcs
+
+    // ASes formatted by one task of dump_local_ribs_tsv
+    static constexpr size_t DUMP_CHUNK_SIZE = 256;
+
+    void append_rib_dump_row(std::string& buffer, int asn, uint32_t prefix_id, AnnID ann_id) const {
+        // Appends asn, prefix, as_path, timestamp, origin, prefix_id and prefix_block_id.
+        // There are no prefix blocks, so prefix_block_id is the prefix ID
+        char digits[16];
+        auto append_int = [&](long long value) {
+            buffer.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+        };
+        const Ann& ann = (*ann_arena)[ann_id];
+        const ASPathStore& as_paths = ann_arena->as_paths();
+
+        append_int(asn);
+        buffer.push_back('\t');
+        buffer.append(prefix_table.get_prefix(prefix_id));
+        buffer.append("\t{");
+        int origin = 0;
+        for (ASPathID path_id = ann.as_path; path_id != EMPTY_AS_PATH; path_id = as_paths.node(path_id).parent) {
+            if (path_id != ann.as_path) {
+                buffer.push_back(',');
+            }
+            origin = as_paths.node(path_id).asn;
+            append_int(origin);
+        }
+        buffer.append("}\t");
+        append_int(seed_batch->timestamps[ann.seed_index]);
+        buffer.push_back('\t');
+        if (ann.as_path != EMPTY_AS_PATH) {
+            append_int(origin);
+        }
+        buffer.push_back('\t');
+        append_int(prefix_id);
+        buffer.push_back('\t');
+        append_int(prefix_id);
+        buffer.push_back('\n');
     }
 
-    if (current_ann->as_path.size() < new_ann->as_path.size()) {
-        return current_ann;
-    } else if (current_ann->as_path.size() > new_ann->as_path.size()) {
-        return new_ann;
-    } else {
-        return nullptr;
-    }
-}
+    size_t dump_local_ribs_tsv(const std::string& path, const std::vector<uint32_t>& as_indices) {
+        std::ofstream file(path, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Could not open file for writing: " + path);
+        }
+        file << "asn\tprefix\tas_path\ttimestamp\torigin\tprefix_id\tprefix_block_id\n";
+
+        // Chunks are formatted a wave at a time so memory doesn't grow with
+        // the size of the dump; buffers keep their capacity between waves
+        size_t num_chunks = (as_indices.size() + DUMP_CHUNK_SIZE - 1) / DUMP_CHUNK_SIZE;
+        size_t wave_size = thread_pool->size() * 4;
+        std::vector<std::string> buffers(std::min(wave_size, num_chunks));
+        std::vector<size_t> buffer_rows(buffers.size());
+        size_t num_rows = 0;
+        for (size_t first_chunk = 0; first_chunk < num_chunks; first_chunk += wave_size) {
+            size_t wave_chunks = std::min(wave_size, num_chunks - first_chunk);
+            for_each_index(wave_chunks, true, [&](size_t i) {
+                size_t first = (first_chunk + i) * DUMP_CHUNK_SIZE;
+                size_t last = std::min(first + DUMP_CHUNK_SIZE, as_indices.size());
+                buffers[i].clear();
+                buffer_rows[i] = 0;
+                for (size_t j = first; j < last; ++j) {
+                    uint32_t as_index = as_indices[j];
+                    int asn = as_graph->asns[as_index];
+                    for (const auto& [prefix_id, ann_id] : (*policies)[as_index].localRIB.prefix_anns()) {
+                        append_rib_dump_row(buffers[i], asn, prefix_id, ann_id);
+                        ++buffer_rows[i];
+                    }
+                }
+            });
+            for (size_t i = 0; i < wave_chunks; ++i) {
+                file.write(buffers[i].data(), static_cast<std::streamsize>(buffers[i].size()));
+                num_rows += buffer_rows[i];
+            }
+        }
 
-std::shared_ptr<Announcement> BGPSimplePolicy::get_best_ann_by_lowest_neighbor_asn_tiebreaker(const std::shared_ptr<Announcement>& current_ann, const std::shared_ptr<Announcement>& new_ann) {
-    // Determines if the new announcement is better than the current announcement by Gao-Rexford criteria for ties
-    if (!current_ann || current_ann->as_path.empty() || !new_ann || new_ann->as_path.empty()) {
-        throw std::runtime_error("Invalid announcement or empty AS path in get_best_ann_by_lowest_neighbor_asn_tiebreaker.");
+        file.close();
+        if (!file) {
+            throw std::runtime_error("Failed writing file: " + path);
+        }
+        return num_rows;
     }
 
-    int current_neighbor_asn = current_ann->as_path.size() > 1 ? current_ann->as_path[1] : current_ann->as_path[0];
-    int new_neighbor_asn = new_ann->as_path.size() > 1 ? new_ann->as_path[1] : new_ann->as_path[0];
+    size_t dump_local_ribs_binary(const std::string& path, const std::vector<uint32_t>& as_indices) {
+        // Arrays, in order: prefix_chars and prefix_offsets (the prefix of ID
+        // i is prefix_chars[prefix_offsets[i], prefix_offsets[i + 1])), then
+        // the RIBColumns asns, prefix_ids, recv_relationships, timestamps,
+        // path_offsets and path_asns
+        std::shared_ptr<RIBColumns> columns = collect_rib_columns(as_indices);
+
+        std::vector<char> prefix_chars;
+        std::vector<uint64_t> prefix_offsets(1, 0);
+        for (uint32_t prefix_id = 0; prefix_id < prefix_table.size(); ++prefix_id) {
+            const std::string& prefix = prefix_table.get_prefix(prefix_id);
+            prefix_chars.insert(prefix_chars.end(), prefix.begin(), prefix.end());
+            prefix_offsets.push_back(prefix_chars.size());
+        }
 
-    if (current_neighbor_asn <= new_neighbor_asn) {
-        return current_ann;
-    } else {
-        return new_ann;
+        ASGraphSnapshotWriter writer(path);
+        writer.write_header(RIB_DUMP_MAGIC, RIB_DUMP_VERSION);
+        writer.write_array(prefix_chars);
+        writer.write_array(prefix_offsets);
+        writer.write_array(columns->asns);
+        writer.write_array(columns->prefix_ids);
+        writer.write_array(columns->recv_relationships);
+        writer.write_array(columns->timestamps);
+        writer.write_array(columns->path_offsets);
+        writer.write_array(columns->path_asns);
+        writer.close();
+        return columns->asns.size();
     }
-}
 
-///////////////////////////////// propagate
-void BGPSimplePolicy::propagate(Relationships propagate_to, const std::set<Relationships>& send_rels) {
-    std::vector<std::weak_ptr<AS>> neighbors;
-
-    auto as_shared = as.lock();
-    if (!as_shared) {
-        // Handle the case where the AS object is no longer valid
-        throw std::runtime_error("Weak ref from policy to as no longer exists");
+    ///////////////////////setup funcs
+    std::map<std::string, PolicyClass> name_to_policy_class_dict;
+    // Method to register a policy class under the name Python uses for it
+    template <typename PolicyType>
+    void register_policy_class(const std::string& name) {
+        name_to_policy_class_dict[name] = {
+            [](size_t size) -> std::unique_ptr<PolicyBlock> {
+                return std::make_unique<TypedPolicyBlock<PolicyType>>(size);
+            },
+            &PolicyBatchKernels<PolicyType>::kernels()
+        };
     }
+    // Class of every AS's policy, as chosen by set_as_classes()
+    std::vector<const PolicyClass*> as_policy_classes;
+    // Backend the local RIBs were configured with in setup()
+    LocalRIBBackend local_rib_backend = LocalRIBBackend::AUTO;
 
-    switch (propagate_to) {
-        case Relationships::PROVIDERS:
-            neighbors = as_shared->providers;
-            break;
-        case Relationships::PEERS:
-            neighbors = as_shared->peers;
-            break;
-        case Relationships::CUSTOMERS:
-            neighbors = as_shared->customers;
-            break;
-        default:
-            throw std::runtime_error("Unsupported relationship type.");
+    // Method to register all policies
+    void register_policies() {
+        // Example of registering a base policy
+        register_policy_class<BGPSimplePolicy>("BGPSimplePolicy");
+        register_policy_class<ROVSimplePolicy>("ROVSimplePolicy");
+        // Register other policies similarly
+        // e.g., register_policy_class<SpecificPolicy>("SpecificPolicy");
     }
+    void set_as_classes(const std::string& base_policy_class_str, const std::map<int, std::string>& non_default_asn_cls_str_dict) {
+        std::vector<const PolicyClass*> previous_policy_classes;
+        previous_policy_classes.swap(as_policy_classes);
+        as_policy_classes.assign(as_graph->size(), nullptr);
+        for (uint32_t as_index = 0; as_index < as_graph->size(); ++as_index) {
+            // Determine the policy class string to use
+            auto cls_str_it = non_default_asn_cls_str_dict.find(as_graph->asns[as_index]);
+            const std::string& policy_class_str = (cls_str_it != non_default_asn_cls_str_dict.end()) ? cls_str_it->second : base_policy_class_str;
 
-    for (const auto& neighbor_weak : neighbors) {
-        for (const auto& [prefix, ann] : localRIB.prefix_anns()) {
-            if (send_rels.find(ann->recv_relationship) != send_rels.end() && !prev_sent(neighbor_weak, ann)) {
-                if (policy_propagate(neighbor_weak, ann, propagate_to, send_rels)) {
-                    continue;
-                } else {
-                    process_outgoing_ann(neighbor_weak, ann, propagate_to, send_rels);
-                }
+            // Find the policy class in the dictionary
+            auto class_it = name_to_policy_class_dict.find(policy_class_str);
+            if (class_it == name_to_policy_class_dict.end()) {
+                throw std::runtime_error("Policy class not implemented: " + policy_class_str);
             }
+            as_policy_classes[as_index] = &class_it->second;
+        }
+        // Unchanged assignments keep their policies
+        if (as_policy_classes != previous_policy_classes || policies->size() != as_graph->size()) {
+            build_policy_set(*policies);
         }
     }
-}
-
-bool BGPSimplePolicy::policy_propagate(const std::weak_ptr<AS>& neighbor_weak, const std::shared_ptr<Announcement>& ann, Relationships propagate_to, const std::set<Relationships>& send_rels) {
-    // This method simply returns false and does not use the neighbor_weak reference
-    return false;
-}
-
-bool BGPSimplePolicy::prev_sent(const std::weak_ptr<AS>& neighbor_weak, const std::shared_ptr<Announcement>& ann) {
-    // This method simply returns false and does not use the neighbor_weak reference
-    return false;
-}
-
-void BGPSimplePolicy::process_outgoing_ann(const std::weak_ptr<AS>& neighbor_weak, const std::shared_ptr<Announcement>& ann, Relationships propagate_to, const std::set<Relationships>& send_rels) {
-    auto neighbor = neighbor_weak.lock();
-    if (!neighbor || !neighbor->policy) {
-        throw std::runtime_error("weak ref no longer exists");
+    void reset_policies() {
+        for (Policy* policy : *policies) {
+            if (policy->localRIB.size() != 0 || policy->recvQueue.size() != 0) {
+                policy->reset();
+            }
+        }
     }
-    neighbor->policy->receive_ann(ann);
-}
-
-
-// Factory function type for creating Policy objects
-using PolicyFactoryFunc = std::function<std::unique_ptr<Policy>()>;
-
-class CPPSimulationEngine {
-public:
-    std::unique_ptr<ASGraph> as_graph;
-    int ready_to_run_round;
-
+    void build_policy_set(PolicySet& policy_set) {
+        // Creates the policy of every AS as a member of policy_set, one
+        // block per class
+        std::map<const PolicyClass*, std::vector<uint32_t>> class_as_indices;
+        for (uint32_t as_index = 0; as_index < as_graph->size(); ++as_index) {
+            class_as_indices[as_policy_classes[as_index]].push_back(as_index);
+        }
 
-    // Constructor now accepts a unique_ptr to ASGraph
-    CPPSimulationEngine(std::unique_ptr<ASGraph> as_graph, int ready_to_run_round = -1)
-        : as_graph(std::move(as_graph)), ready_to_run_round(ready_to_run_round) {
+        policy_set.policies.assign(as_graph->size(), nullptr);
+        policy_set.blocks.clear();
+        std::vector<const PolicyKernels*> as_kernels(as_graph->size());
+        for (const auto& [policy_class, as_indices] : class_as_indices) {
+            auto block = policy_class->make_block(as_indices.size());
+            for (size_t i = 0; i < as_indices.size(); ++i) {
+                Policy& policy = (*block)[i];
+                //set the reference to the AS
+                policy.as_graph = as_graph.get();
+                policy.as_index = as_indices[i];
+                policy.ann_arena = ann_arena.get();
+                policy.neighbor_policies = &policy_set;
+                policy_set.policies[as_indices[i]] = &policy;
+                as_kernels[as_indices[i]] = policy_class->kernels;
+            }
+            policy_set.blocks.push_back(std::move(block));
+        }
 
-        register_policies();  // Register policy types upon construction
+        auto group_by_class = [&](const auto& as_indices) {
+            std::vector<PolicySet::Group> groups;
+            for (uint32_t as_index : as_indices) {
+                auto group = std::find_if(groups.begin(), groups.end(), [&](const PolicySet::Group& g) {
+                    return g.kernels == as_kernels[as_index];
+                });
+                if (group == groups.end()) {
+                    groups.push_back({as_kernels[as_index], {}});
+                    group = groups.end() - 1;
+                }
+                group->policies.push_back(policy_set.policies[as_index]);
+            }
+            return groups;
+        };
+        policy_set.rank_groups.clear();
+        for (const auto& rank : as_graph->propagation_ranks) {
+            policy_set.rank_groups.push_back(group_by_class(rank));
+        }
+        std::vector<uint32_t> all_as_indices(as_graph->size());
+        std::iota(all_as_indices.begin(), all_as_indices.end(), 0);
+        policy_set.all_groups = group_by_class(all_as_indices);
     }
-
-    // Disable copy semantics
-    CPPSimulationEngine(const CPPSimulationEngine&) = delete;
-    CPPSimulationEngine& operator=(const CPPSimulationEngine&) = delete;
-
-    // Enable move semantics
-    CPPSimulationEngine(CPPSimulationEngine&&) = default;
-    CPPSimulationEngine& operator=(CPPSimulationEngine&&) = default;
-
-
-    void setup(const std::vector<std::shared_ptr<Announcement>>& announcements,
-               const std::string& base_policy_class_str = "BGPSimplePolicy",
-               const std::map<int, std::string>& non_default_asn_cls_str_dict = {}) {
-        std::cout<<"in here"<<std::endl;
-        set_as_classes(base_policy_class_str, non_default_asn_cls_str_dict);
-
-        std::cout<<"here"<<std::endl;
-        seed_announcements(announcements);
-
-        std::cout<<"out here"<<std::endl;
-        ready_to_run_round = 0;
+    void configure_local_ribs(LocalRIBBackend local_rib_backend) {
+        // Sizes every AS's LocalRIB for the prefix table of this run
+        this->local_rib_backend = local_rib_backend;
+        for (Policy* policy : *policies) {
+            policy->localRIB.configure(local_rib_backend, prefix_table.size());
+        }
     }
-
-    void run(int propagation_round = 0) {
-
+    void seed_announcements(std::shared_ptr<const AnnouncementBatch> announcements) {
         auto start = std::chrono::high_resolution_clock::now();
-        // Ensure that the simulator is ready to run this round
-        if (ready_to_run_round != propagation_round) {
-            throw std::runtime_error("Engine not set up to run for round " + std::to_string(propagation_round));
-        }
+        seed_batch = std::move(announcements);
+        const AnnouncementBatch& batch = *seed_batch;
+        for (uint32_t seed_index = 0; seed_index < batch.size(); ++seed_index) {
+            if (!batch.seed_asns[seed_index].has_value()) {
+                throw std::runtime_error("Announcement seed ASN is not set.");
+            }
 
-        // Propagate announcements
-        propagate(propagation_round);
+            uint32_t as_index = as_graph->get_index(batch.seed_asns[seed_index].value());
+            if (as_index == NO_AS_INDEX) {
+                throw std::runtime_error("AS object not found in ASGraph.");
+            }
 
-        // Increment the ready to run round
-        ready_to_run_round++;
+            uint32_t prefix_id = batch.prefix_ids[seed_index];
+            Policy& policy_to_seed = (*policies)[as_index];
+            if (policy_to_seed.localRIB.get_ann(prefix_id) != NO_ANN) {
+                throw std::runtime_error("Seeding conflict: Announcement already exists in the local RIB.");
+            }
+
+            // Row seed_index of the batch keeps the fields every copy shares
+            const int* path_first = batch.path_asns.data() + batch.path_offsets[seed_index];
+            const int* path_last = batch.path_asns.data() + batch.path_offsets[seed_index + 1];
+            AnnID ann_id = ann_arena->add({
+                prefix_id,
+                ann_arena->as_paths().intern(path_first, path_last),
+                seed_index,
+                batch.recv_relationships[seed_index],
+                true,
+                batch.invalid_by_roa(seed_index)
+            });
+            policy_to_seed.localRIB.add_ann(prefix_id, ann_id);
+        }
         auto end = std::chrono::high_resolution_clock::now();
         std::chrono::duration<double> elapsed = end - start;
-        std::cout << "Propagated in "
-                  << std::fixed << std::setprecision(2) << elapsed.count() << " seconds." << std::endl;
+        if (verbose) {
+            std::cout << "Seeded " << batch.size() << " announcements in "
+                      << std::fixed << std::setprecision(2) << elapsed.count() << " seconds." << std::endl;
+        }
 
     }
 
-    std::vector<std::shared_ptr<Announcement>> get_announcements_from_tsv(const std::string& path) {
-        std::vector<std::shared_ptr<Announcement>> announcements;
-        std::ifstream file(path);
-        std::string line;
-
-        // Skip the header line
-        std::getline(file, line);
-        std::string expectedHeaderStart = "prefix\tas_path\ttimestamp\tseed_asn\troa_valid_length\troa_origin\trecv_relationship\twithdraw\ttraceback_end\tcommunities";
-        if (line.find(expectedHeaderStart) != 0) {
-            throw std::runtime_error("TSV file header does not start with the expected format.");
+    void mark_lazy_stubs() {
+        // Picks the ASes lazy_stubs leaves out of propagation. An AS without
+        // customers only sends its seeded routes, so one without seeds only
+        // ever receives
+        auto& lazy_states = policies->lazy_states;
+        lazy_states.clear();
+        policies->materialized.clear();
+        if (!lazy_stubs) {
+            return;
+        }
+        lazy_states.assign(as_graph->size(), PolicySet::LazyState::PROPAGATED);
+        policies->materialized.assign(as_graph->size(), 0);
+        for (uint32_t as_index = 0; as_index < as_graph->size(); ++as_index) {
+            if (as_graph->customers.neighbors(as_index).empty() && (*policies)[as_index].localRIB.size() == 0) {
+                lazy_states[as_index] = PolicySet::LazyState::LAZY;
+            }
         }
+    }
 
+    ///////////////////lazy stub funcs
+
+    void materialize_lazy_stub(uint32_t as_index) {
+        // Computes the routes of a lazy stub after run(), by redoing the
+        // peer and provider phases of propagate() at that AS against the
+        // final RIBs of its neighbors. A neighbor's RIB only improves, so
+        // its final entry is the best it ever sent. Results are kept until
+        // the RIBs change again
+        PolicySet& policy_set = *policies;
+        if (!policy_set.is_lazy(as_index) || policy_set.materialized[as_index] || ready_to_run_round <= 0) {
+            return;
+        }
+        Policy& policy = policy_set[as_index];
+        std::vector<RecvQueue::entry_type> received;
+        for (Relationships from_rel : {Relationships::PEERS, Relationships::PROVIDERS}) {
+            for (uint32_t neighbor_index : as_graph->neighbors(as_index, from_rel)) {
+                // Other lazy stubs have no routes to send
+                if (policy_set.is_lazy(neighbor_index)) {
+                    continue;
+                }
+                received.clear();
+                for (const auto& [prefix_id, ann_id] : policy_set[neighbor_index].localRIB.prefix_anns()) {
+                    // Providers send everything; peers only their customer routes
+                    AnnID sent_ann_id = from_rel == Relationships::PROVIDERS ? ann_id : exported_up(ann_id);
+                    if (sent_ann_id != NO_ANN) {
+                        received.emplace_back(prefix_id, sent_ann_id);
+                    }
+                }
+                policy.receive_anns(received);
+            }
+            policy.process_incoming_anns(from_rel, ready_to_run_round - 1);
+        }
+        // Lazy stubs never send anything
+        policy.localRIB.clear_changes();
+        policy_set.materialized[as_index] = 1;
+    }
 
+    void materialize_lazy_stubs(const std::vector<uint32_t>& as_indices) {
+        // Every AS only writes its own RIB and materialized flag, and reads
+        // the RIBs of propagated ASes
+        if (policies->lazy_states.empty()) {
+            return;
+        }
+        for_each_index(as_indices.size(), true, [&](size_t i) {
+            materialize_lazy_stub(as_indices[i]);
+        });
+    }
 
-        while (std::getline(file, line)) {
-            std::istringstream iss(line);
-            std::string token;
+    void invalidate_lazy_stub(uint32_t as_index) {
+        // Drops computed routes of a lazy stub whose neighbors' RIBs changed
+        if (policies->is_lazy(as_index) && policies->materialized[as_index]) {
+            (*policies)[as_index].reset();
+            policies->materialized[as_index] = 0;
+        }
+    }
 
-            std::string prefix;
-            std::vector<int> as_path;
-            int timestamp;
-            std::optional<int> seed_asn;
-            std::optional<bool> roa_valid_length;
-            std::optional<int> roa_origin;
-            Relationships recv_relationship;
-            bool withdraw;
-            bool traceback_end;
-            std::vector<std::string> communities;
+    void invalidate_lazy_stubs() {
+        for (uint32_t as_index = 0; as_index < policies->lazy_states.size(); ++as_index) {
+            invalidate_lazy_stub(as_index);
+        }
+    }
 
-            // Parse each field
-            std::getline(iss, prefix, '\t');
+    ///////////////////incremental propagation funcs
 
-            // Parse as_path
-            if (std::getline(iss, token, '\t')) {
-                std::istringstream as_path_stream(token.substr(1, token.size() - 2)); // Strip braces
-                std::string as_num;
-                while (std::getline(as_path_stream, as_num, ',')) {
-                    as_path.push_back(std::stoi(as_num));
-                }
+    bool same_route(AnnID ann_id, AnnID other_ann_id) const {
+        // Whether two RIB entries would be sent and compared the same way
+        if (ann_id == NO_ANN || other_ann_id == NO_ANN) {
+            return ann_id == other_ann_id;
+        }
+        const Ann& ann = (*ann_arena)[ann_id];
+        const Ann& other_ann = (*ann_arena)[other_ann_id];
+        if (ann.seed_index != other_ann.seed_index || ann.recv_relationship != other_ann.recv_relationship) {
+            return false;
+        }
+        const ASPathStore& as_paths = ann_arena->as_paths();
+        ASPathID path_id = ann.as_path;
+        ASPathID other_path_id = other_ann.as_path;
+        while (path_id != other_path_id) {
+            const ASPathNode& node = as_paths.node(path_id);
+            const ASPathNode& other_node = as_paths.node(other_path_id);
+            if (node.asn != other_node.asn || node.length != other_node.length) {
+                return false;
             }
+            path_id = node.parent;
+            other_path_id = other_node.parent;
+        }
+        return true;
+    }
 
-            // Parse timestamp, etc.
-            std::getline(iss, token, '\t'); timestamp = std::stoi(token);
-            // Similar parsing for other fields
-
-            if (std::getline(iss, token, '\t') && !token.empty()) {
-                seed_asn = std::stoi(token);
-            }
+    AnnID exported_up(AnnID ann_id) const {
+        // The part of a RIB entry sent to providers and peers
+        if (ann_id == NO_ANN) {
+            return NO_ANN;
+        }
+        Relationships recv_relationship = (*ann_arena)[ann_id].recv_relationship;
+        return recv_relationship == Relationships::ORIGIN || recv_relationship == Relationships::CUSTOMERS ? ann_id : NO_ANN;
+    }
 
-            // Parse roa_valid_length (optional)
-            if (std::getline(iss, token, '\t') && !token.empty()) {
-                roa_valid_length = (token == "True");
+    void reselect(uint32_t as_index, const std::vector<uint32_t>& prefix_ids, Relationships from_rel) {
+        // Redoes the from_rel phase of propagate() at one AS for prefix_ids.
+        // Routes that phase and later ones chose are dropped, then whatever
+        // the from_rel neighbors send now goes through the AS's policy
+        Policy& policy = (*policies)[as_index];
+        for (uint32_t prefix_id : prefix_ids) {
+            AnnID ann_id = policy.localRIB.get_ann(prefix_id);
+            if (ann_id == NO_ANN || (*ann_arena)[ann_id].seeded) {
+                continue;
             }
-
-            // Parse roa_origin (optional)
-            if (std::getline(iss, token, '\t') && !token.empty()) {
-                roa_origin = std::stoi(token);
+            Relationships recv_relationship = (*ann_arena)[ann_id].recv_relationship;
+            if (recv_relationship == Relationships::PROVIDERS ||
+                (recv_relationship == Relationships::PEERS && from_rel != Relationships::PROVIDERS) ||
+                from_rel == Relationships::CUSTOMERS) {
+                policy.localRIB.remove_ann(prefix_id);
             }
-
-            // Parse recv_relationship (convert to enum)
-            if (std::getline(iss, token, '\t') && !token.empty()) {
-                int rel_value = std::stoi(token);
-                switch (rel_value) {
-                    case 0: recv_relationship = Relationships::ORIGIN; break;
-                    case 1: recv_relationship = Relationships::PROVIDERS; break;
-                    case 2: recv_relationship = Relationships::PEERS; break;
-                    case 3: recv_relationship = Relationships::CUSTOMERS; break;
-                    case 4: recv_relationship = Relationships::ORIGIN; break;
-                    default:
-                        throw std::runtime_error("Invalid recv_relationship value: " + token);
+        }
+        for (uint32_t neighbor_index : as_graph->neighbors(as_index, from_rel)) {
+            const LocalRIB& neighbor_rib = (*policies)[neighbor_index].localRIB;
+            for (uint32_t prefix_id : prefix_ids) {
+                AnnID ann_id = neighbor_rib.get_ann(prefix_id);
+                // Providers send everything; customers and peers only their customer routes
+                if (from_rel != Relationships::PROVIDERS) {
+                    ann_id = exported_up(ann_id);
+                }
+                if (ann_id != NO_ANN) {
+                    policy.receive_ann(prefix_id, ann_id);
                 }
-            } else {
-                throw std::runtime_error("Missing or empty recv_relationship value.");
             }
-            // Assuming Relationships can be converted from int/string
-            // recv_relationship = ...
+        }
+        policy.process_incoming_anns(from_rel, 0);
+        // repropagate() tracks what changed itself, so the log isn't kept
+        policy.localRIB.clear_changes();
+    }
 
-            // Parse withdraw
-            std::getline(iss, token, '\t');
-            withdraw = (token == "True");
+    static uint64_t route_key(uint32_t as_index, uint32_t prefix_id) {
+        return (static_cast<uint64_t>(as_index) << 32) | prefix_id;
+    }
 
-            // Parse traceback_end
-            std::getline(iss, token, '\t');
-            traceback_end = (token == "True");
+    size_t repropagate(std::vector<std::vector<uint32_t>> changed_prefixes,
+                       std::unordered_map<uint64_t, AnnID> old_routes = {}) {
+        // Brings the converged local RIBs up to date after the routes of
+        // (AS, prefix) pairs in changed_prefixes may have changed, by
+        // redoing the three phases of propagate() only where an input
+        // changed: a pair is recomputed in a phase if it changed itself or
+        // a neighbor it hears from in that phase now sends something else.
+        // old_routes has the RIB entries of pairs edited before the call,
+        // keyed by route_key(). Returns the number of pairs recomputed in
+        // the last phase
+        size_t num_ases = as_graph->size();
+        // Pairs to redo in each phase, per AS. Whatever is redone in a
+        // phase is redone in the later ones too, since reselect() drops
+        // their routes
+        std::vector<std::vector<uint32_t>> peer_prefixes(num_ases);
+        std::vector<std::vector<uint32_t>> provider_prefixes(num_ases);
+        // RIB entries before anything was redone
+        auto key = route_key;
+        auto prepare = [&](uint32_t as_index, std::vector<uint32_t>& prefix_ids) {
+            std::sort(prefix_ids.begin(), prefix_ids.end());
+            prefix_ids.erase(std::unique(prefix_ids.begin(), prefix_ids.end()), prefix_ids.end());
+            const LocalRIB& rib = (*policies)[as_index].localRIB;
+            for (uint32_t prefix_id : prefix_ids) {
+                old_routes.emplace(key(as_index, prefix_id), rib.get_ann(prefix_id));
+            }
+        };
 
-            // Parse communities
-            if (std::getline(iss, token, '\t') && !token.empty()) {
-                std::istringstream communities_stream(token.substr(1, token.size() - 2)); // Strip braces
-                std::string community;
-                while (std::getline(communities_stream, community, ',')) {
-                    communities.push_back(community);
+        // Customers to providers: customer routes only move up the ranks
+        for (const auto& rank : as_graph->propagation_ranks) {
+            for (uint32_t as_index : rank) {
+                auto& prefix_ids = changed_prefixes[as_index];
+                if (prefix_ids.empty()) {
+                    continue;
+                }
+                // Lazy stubs never send anything; they're recomputed on demand
+                if (policies->is_lazy(as_index)) {
+                    invalidate_lazy_stub(as_index);
+                    std::vector<uint32_t>().swap(prefix_ids);
+                    continue;
+                }
+                prepare(as_index, prefix_ids);
+                reselect(as_index, prefix_ids, Relationships::CUSTOMERS);
+                const LocalRIB& rib = (*policies)[as_index].localRIB;
+                for (uint32_t prefix_id : prefix_ids) {
+                    if (!same_route(exported_up(old_routes[key(as_index, prefix_id)]), exported_up(rib.get_ann(prefix_id)))) {
+                        for (uint32_t provider_index : as_graph->providers.neighbors(as_index)) {
+                            changed_prefixes[provider_index].push_back(prefix_id);
+                        }
+                        for (uint32_t peer_index : as_graph->peers.neighbors(as_index)) {
+                            peer_prefixes[peer_index].push_back(prefix_id);
+                        }
+                    }
                 }
+                peer_prefixes[as_index].insert(peer_prefixes[as_index].end(), prefix_ids.begin(), prefix_ids.end());
+                std::vector<uint32_t>().swap(prefix_ids);
             }
+        }
 
-            std::shared_ptr<Announcement> ann = std::make_shared<Announcement>(
-                prefix, as_path, timestamp, seed_asn, roa_valid_length,
-                roa_origin, recv_relationship, withdraw, traceback_end, communities
-            );
-            announcements.push_back(ann);
+        // Peers: what peers send only depends on the first phase
+        for (uint32_t as_index = 0; as_index < num_ases; ++as_index) {
+            auto& prefix_ids = peer_prefixes[as_index];
+            if (prefix_ids.empty()) {
+                continue;
+            }
+            if (policies->is_lazy(as_index)) {
+                invalidate_lazy_stub(as_index);
+                std::vector<uint32_t>().swap(prefix_ids);
+                continue;
+            }
+            prepare(as_index, prefix_ids);
+            reselect(as_index, prefix_ids, Relationships::PEERS);
+            provider_prefixes[as_index].insert(provider_prefixes[as_index].end(), prefix_ids.begin(), prefix_ids.end());
+            std::vector<uint32_t>().swap(prefix_ids);
         }
 
-        return announcements;
+        // Providers to customers, top rank first
+        size_t num_recomputed = 0;
+        for (auto rank = as_graph->propagation_ranks.rbegin(); rank != as_graph->propagation_ranks.rend(); ++rank) {
+            for (uint32_t as_index : *rank) {
+                auto& prefix_ids = provider_prefixes[as_index];
+                if (prefix_ids.empty()) {
+                    continue;
+                }
+                if (policies->is_lazy(as_index)) {
+                    invalidate_lazy_stub(as_index);
+                    std::vector<uint32_t>().swap(prefix_ids);
+                    continue;
+                }
+                prepare(as_index, prefix_ids);
+                reselect(as_index, prefix_ids, Relationships::PROVIDERS);
+                const LocalRIB& rib = (*policies)[as_index].localRIB;
+                for (uint32_t prefix_id : prefix_ids) {
+                    if (!same_route(old_routes[key(as_index, prefix_id)], rib.get_ann(prefix_id))) {
+                        for (uint32_t customer_index : as_graph->customers.neighbors(as_index)) {
+                            provider_prefixes[customer_index].push_back(prefix_id);
+                        }
+                    }
+                }
+                num_recomputed += prefix_ids.size();
+                std::vector<uint32_t>().swap(prefix_ids);
+            }
+        }
+        return num_recomputed;
     }
 
-protected:
+    ///////////////////propagation funcs
 
-    ///////////////////////setup funcs
-    std::map<std::string, PolicyFactoryFunc> name_to_policy_func_dict;
-    // Method to register policy factory functions
-    void register_policy_factory(const std::string& name, const PolicyFactoryFunc& factory) {
-        name_to_policy_func_dict[name] = factory;
-    }
-    // Method to register all policies
-    void register_policies() {
-        // Example of registering a base policy
-        register_policy_factory("BGPSimplePolicy", []() -> std::unique_ptr<Policy>{
-            std::cout <<"in register_policy"<<std::endl;
-            return std::make_unique<BGPSimplePolicy>();
-        });
-        // Register other policies similarly
-        // e.g., register_policy_factory("SpecificPolicy", ...);
+    void set_num_threads(size_t num_threads) {
+        num_threads = std::max<size_t>(num_threads, 1);
+        if (!thread_pool || thread_pool->size() != num_threads) {
+            thread_pool = std::make_unique<ThreadPool>(num_threads);
+        }
+        ann_arena->set_num_workers(num_threads);
     }
-    void set_as_classes(const std::string& base_policy_class_str, const std::map<int, std::string>& non_default_asn_cls_str_dict) {
-        std::cout << "in set_as_classes" << std::endl;
-        for (auto& [asn, as_obj] : as_graph->as_dict) {
 
-                std::cout << "in set_as_classes loop" << std::endl;
-            // Determine the policy class string to use
-            auto cls_str_it = non_default_asn_cls_str_dict.find(as_obj->asn);
-
-            std::cout << "a" << std::endl;
-            std::string policy_class_str = (cls_str_it != non_default_asn_cls_str_dict.end()) ? cls_str_it->second : base_policy_class_str;
-            std::cout << "b" << std::endl;
-
-            // Find the factory function in the dictionary
-            auto factory_it = name_to_policy_func_dict.find(policy_class_str);
-
-            std::cout << "c" << std::endl;
-            if (factory_it == name_to_policy_func_dict.end()) {
-                throw std::runtime_error("Policy class not implemented: " + policy_class_str);
+    template <typename Func>
+    void for_each_index(size_t n, bool parallel, const Func& func) {
+        // Runs func(i) for i in [0, n), on the thread pool if parallel, and
+        // returns once all are done
+        if (parallel) {
+            thread_pool->parallel_for(n, func);
+        } else {
+            for (size_t i = 0; i < n; ++i) {
+                func(i);
             }
+        }
+    }
 
-            std::cout << "d" << std::endl;
-            // Create and set the new policy object
-
-            // Create the policy object using the factory function
-            auto policy_object = factory_it->second();
-            std::cout << "Policy object created" << std::endl; // Print statement
-            // Assign the created policy object to as_obj->policy
-            as_obj->policy = std::move(policy_object);
+    // A contiguous range of prefix IDs with a private policy per AS, so it
+    // can be propagated by one thread without touching any other shard
+    struct PrefixShard {
+        uint32_t first_prefix_id;
+        uint32_t end_prefix_id;
+        PolicySet policies;
+    };
 
-            std::cout << "g" << std::endl;
-            //set the reference to the AS
-            as_obj->policy->as = std::weak_ptr<AS>(as_obj->shared_from_this());
+    void propagate_prefix_sharded(int propagation_round) {
+        // Runs the full propagation for every shard in parallel against the
+        // shared graph, then merges the shards' local RIBs back into the
+        // engine's. Prefixes never interact, so results match propagate()
+        auto start = std::chrono::high_resolution_clock::now();
+        PolicySet& policies = *this->policies;
+        size_t num_prefixes = prefix_table.size();
+        if (num_prefixes == 0) {
+            return;
+        }
 
-            std::cout << "f" << std::endl;
+        // Balance shards by the number of RIB entries each prefix starts with
+        std::vector<size_t> prefix_weights(num_prefixes, 0);
+        size_t total_weight = 0;
+        for (const Policy* policy : policies) {
+            for (const auto& [prefix_id, ann_id] : policy->localRIB.prefix_anns()) {
+                ++prefix_weights[prefix_id];
+                ++total_weight;
+            }
         }
-    }
-    void seed_announcements(const std::vector<std::shared_ptr<Announcement>>& announcements) {
-        auto start = std::chrono::high_resolution_clock::now();
-        for (const auto& ann : announcements) {
-            if (!ann || !ann->seed_asn.has_value()) {
-                throw std::runtime_error("Announcement seed ASN is not set.");
+        size_t max_shards = std::min(thread_pool->size(), num_prefixes);
+        std::vector<uint32_t> prefix_shards(num_prefixes);
+        std::vector<PrefixShard> shards(1);
+        shards[0].first_prefix_id = 0;
+        size_t weight = 0;
+        for (uint32_t prefix_id = 0; prefix_id < num_prefixes; ++prefix_id) {
+            if (prefix_id > 0 && shards.size() < max_shards && weight * max_shards >= total_weight * shards.size()) {
+                shards.back().end_prefix_id = prefix_id;
+                shards.emplace_back();
+                shards.back().first_prefix_id = prefix_id;
             }
-
-            auto as_it = as_graph->as_dict.find(ann->seed_asn.value());
-            if (as_it == as_graph->as_dict.end()) {
-                throw std::runtime_error("AS object not found in ASGraph.");
+            prefix_shards[prefix_id] = static_cast<uint32_t>(shards.size() - 1);
+            weight += prefix_weights[prefix_id];
+        }
+        shards.back().end_prefix_id = static_cast<uint32_t>(num_prefixes);
+
+        // A forced DENSE backend would cost a full prefix array per AS in
+        // every shard, while a shard only holds a slice of the prefixes
+        LocalRIBBackend shard_backend = local_rib_backend == LocalRIBBackend::DENSE ? LocalRIBBackend::AUTO : local_rib_backend;
+        // Shards are only filled in once the vector stops moving, since
+        // policies point at the set they belong to
+        for_each_index(shards.size(), true, [&](size_t shard_index) {
+            auto& shard_policies = shards[shard_index].policies;
+            build_policy_set(shard_policies);
+            shard_policies.lazy_states = policies.lazy_states;
+            for (Policy* policy : shard_policies) {
+                policy->localRIB.configure(shard_backend, num_prefixes);
             }
+        });
 
-            auto& obj_to_seed = as_it->second;
-            if (obj_to_seed->policy->localRIB.get_ann(ann->prefix)) {
-                throw std::runtime_error("Seeding conflict: Announcement already exists in the local RIB.");
+        // Hand every RIB entry to its shard; each AS only touches its own
+        // policies. Only what the engine's RIB hadn't sent yet is logged as
+        // changed, so shards don't send everything again
+        for_each_index(as_graph->size(), true, [&](size_t as_index) {
+            auto& local_rib = policies[as_index].localRIB;
+            for (const auto& [prefix_id, ann_id] : local_rib.prefix_anns()) {
+                shards[prefix_shards[prefix_id]].policies[as_index].localRIB.add_ann(prefix_id, ann_id);
+            }
+            for (auto& shard : shards) {
+                shard.policies[as_index].localRIB.clear_changes();
             }
+            for (uint32_t prefix_id : local_rib.changes()) {
+                shards[prefix_shards[prefix_id]].policies[as_index].localRIB.mark_changed(prefix_id);
+            }
+            local_rib.clear();
+        });
 
-            obj_to_seed->policy->localRIB.add_ann(ann);
+        for_each_index(shards.size(), true, [&](size_t shard_index) {
+            propagate(shards[shard_index].policies, propagation_round, false);
+        });
+        for (const auto& shard : shards) {
+            add_metrics(shard.policies);
         }
+
+        // Shards hold ascending prefix ranges, so every merge is an append
+        for_each_index(as_graph->size(), true, [&](size_t as_index) {
+            auto& local_rib = policies[as_index].localRIB;
+            for (const auto& shard : shards) {
+                for (const auto& [prefix_id, ann_id] : shard.policies[as_index].localRIB.prefix_anns()) {
+                    local_rib.add_ann(prefix_id, ann_id);
+                }
+            }
+            // The shards already sent every merged entry
+            local_rib.clear_changes();
+        });
+
         auto end = std::chrono::high_resolution_clock::now();
         std::chrono::duration<double> elapsed = end - start;
-        std::cout << "Seeded " << announcements.size() << " announcements in "
-                  << std::fixed << std::setprecision(2) << elapsed.count() << " seconds." << std::endl;
+        if (verbose) {
+            std::cout << "Propagated " << shards.size() << " prefix shards in "
+                      << std::fixed << std::setprecision(2) << elapsed.count() << " seconds." << std::endl;
+        }
+    }
 
+    void reset_metrics(int propagation_round, PropagationMode propagation_mode) {
+        // Counters of earlier runs, updates and lookups are dropped
+        metrics = RunMetrics{};
+        metrics.propagation_round = propagation_round;
+        metrics.num_threads = thread_pool->size();
+        metrics.propagation_mode = propagation_mode == PropagationMode::PREFIX_SHARDED ? "PREFIX_SHARDED" : "RANK_PARALLEL";
+        for (Policy* policy : *policies) {
+            policy->counters = PolicyCounters{};
+            policy->recvQueue.reset_counters();
+        }
     }
 
-    ///////////////////propagation funcs
+    void add_metrics(const PolicySet& policies) {
+        // Adds the counters of a propagated set to metrics
+        for (size_t as_index = 0; as_index < policies.size(); ++as_index) {
+            const Policy& policy = policies[as_index];
+            metrics.anns_received += policy.recvQueue.num_received();
+            metrics.anns_processed += policy.counters.processed;
+            metrics.anns_accepted += policy.counters.accepted;
+            metrics.anns_rejected_by_loop += policy.counters.rejected_by_loop;
+            metrics.anns_rejected_by_filter += policy.counters.rejected_by_filter;
+            if (policy.recvQueue.peak_size() > metrics.recv_queue_peak) {
+                metrics.recv_queue_peak = policy.recvQueue.peak_size();
+                metrics.recv_queue_peak_asn = as_graph->asns[as_index];
+            }
+        }
+    }
 
-    void propagate(int propagation_round) {
-        propagate_to_providers(propagation_round);
-        propagate_to_peers(propagation_round);
-        propagate_to_customers(propagation_round);
+    // ASes per kernel call when a group is split across threads
+    static constexpr size_t KERNEL_BATCH_SIZE = 32;
+
+    template <typename Func>
+    void for_each_batch(const std::vector<PolicySet::Group>& groups, bool parallel, const Func& func) {
+        // Runs func(kernels, policies, n) over every group, in batches when
+        // parallel, and returns once all are done
+        for (const auto& group : groups) {
+            size_t size = group.policies.size();
+            size_t num_batches = parallel ? (size + KERNEL_BATCH_SIZE - 1) / KERNEL_BATCH_SIZE : 1;
+            for_each_index(num_batches, parallel, [&](size_t batch) {
+                size_t first = parallel ? batch * KERNEL_BATCH_SIZE : 0;
+                size_t n = parallel ? std::min(KERNEL_BATCH_SIZE, size - first) : size;
+                func(*group.kernels, group.policies.data() + first, n);
+            });
+        }
     }
-    void propagate_to_providers(int propagation_round) {
-        for (size_t i = 0; i < as_graph->propagation_ranks.size(); ++i) {
-            auto& rank = as_graph->propagation_ranks[i];
 
-            if (i > 0) {
-                for (auto& as_obj : rank) {
-                    as_obj->policy->process_incoming_anns(Relationships::CUSTOMERS, propagation_round);
+    // Results don't depend on the number of threads: queues are sorted
+    // before they're processed, and Gao-Rexford always breaks ties by
+    // neighbor ASN, so neither delivery nor allocation order matters.
+    // Only ASes in the same rank are run in parallel since ASes only write
+    // to their own local RIB and to the (locked) queues of other ranks
+    void propagate(PolicySet& policies, int propagation_round, bool parallel, RunMetrics* metrics = nullptr) {
+        // Every RIB's change log is empty once this returns
+        // Phase and rank times go to metrics when given
+        std::vector<RankMetrics>* ranks = nullptr;
+        if (metrics) {
+            metrics->ranks.assign(policies.rank_groups.size(), RankMetrics{});
+            for (size_t i = 0; i < policies.rank_groups.size(); ++i) {
+                for (const auto& group : policies.rank_groups[i]) {
+                    metrics->ranks[i].num_ases += group.policies.size();
                 }
             }
+            ranks = &metrics->ranks;
+        }
+        auto start = std::chrono::high_resolution_clock::now();
+        propagate_to_providers(policies, propagation_round, parallel, ranks);
+        auto providers_end = std::chrono::high_resolution_clock::now();
+        propagate_to_peers(policies, propagation_round, parallel);
+        auto peers_end = std::chrono::high_resolution_clock::now();
+        propagate_to_customers(policies, propagation_round, parallel, ranks);
+        // Routes picked in the peer and customer phases are never sent up,
+        // so the providers and peers watermarks don't reach the end of the
+        // log on their own
+        for_each_index(policies.size(), parallel, [&](size_t as_index) {
+            policies[as_index].localRIB.clear_changes();
+        });
+        auto end = std::chrono::high_resolution_clock::now();
+        if (metrics) {
+            metrics->providers_seconds = std::chrono::duration<double>(providers_end - start).count();
+            metrics->peers_seconds = std::chrono::duration<double>(peers_end - providers_end).count();
+            metrics->customers_seconds = std::chrono::duration<double>(end - peers_end).count();
+        }
+    }
+    void propagate_to_providers(PolicySet& policies, int propagation_round, bool parallel,
+                                std::vector<RankMetrics>* ranks = nullptr) {
+        for (size_t i = 0; i < policies.rank_groups.size(); ++i) {
+            auto& groups = policies.rank_groups[i];
+            auto start = std::chrono::high_resolution_clock::now();
+
+            if (i > 0) {
+                for_each_batch(groups, parallel, [&](const PolicyKernels& kernels, Policy* const* batch, size_t n) {
+                    kernels.process_incoming_anns(batch, n, Relationships::CUSTOMERS, propagation_round);
+                });
+            }
 
-            for (auto& as_obj : rank) {
-                as_obj->policy->propagate_to_providers();
+            for_each_batch(groups, parallel, [](const PolicyKernels& kernels, Policy* const* batch, size_t n) {
+                kernels.propagate_to_providers(batch, n);
+            });
+            if (ranks) {
+                (*ranks)[i].providers_seconds = std::chrono::duration<double>(
+                    std::chrono::high_resolution_clock::now() - start).count();
             }
         }
     }
-    void propagate_to_peers(int propagation_round) {
-        for (auto& [asn, as_obj] : as_graph->as_dict) {
-            as_obj->policy->propagate_to_peers();
-        }
+    void propagate_to_peers(PolicySet& policies, int propagation_round, bool parallel) {
+        for_each_batch(policies.all_groups, parallel, [](const PolicyKernels& kernels, Policy* const* batch, size_t n) {
+            kernels.propagate_to_peers(batch, n);
+        });
 
-        for (auto& [asn, as_obj] : as_graph->as_dict) {
-            as_obj->policy->process_incoming_anns(Relationships::PEERS, propagation_round);
-        }
+        for_each_batch(policies.all_groups, parallel, [&](const PolicyKernels& kernels, Policy* const* batch, size_t n) {
+            kernels.process_incoming_anns(batch, n, Relationships::PEERS, propagation_round);
+        });
     }
 
-    void propagate_to_customers(int propagation_round) {
-        auto& ranks = as_graph->propagation_ranks;
+    void propagate_to_customers(PolicySet& policies, int propagation_round, bool parallel,
+                                std::vector<RankMetrics>* ranks = nullptr) {
+        auto& rank_groups = policies.rank_groups;
         size_t i = 0; // Initialize i to 0
 
-        for (auto it = ranks.rbegin(); it != ranks.rend(); ++it, ++i) {
-            auto& rank = *it;
+        for (auto it = rank_groups.rbegin(); it != rank_groups.rend(); ++it, ++i) {
+            auto& groups = *it;
+            auto start = std::chrono::high_resolution_clock::now();
             // There are no incoming anns in the top row
             if (i > 0) {
-                for (auto& as_obj : rank) {
-                    as_obj->policy->process_incoming_anns(Relationships::PROVIDERS, propagation_round);
-                }
+                for_each_batch(groups, parallel, [&](const PolicyKernels& kernels, Policy* const* batch, size_t n) {
+                    kernels.process_incoming_anns(batch, n, Relationships::PROVIDERS, propagation_round);
+                });
             }
 
-            for (auto& as_obj : rank) {
-                as_obj->policy->propagate_to_customers();
+            for_each_batch(groups, parallel, [](const PolicyKernels& kernels, Policy* const* batch, size_t n) {
+                kernels.propagate_to_customers(batch, n);
+            });
+            if (ranks) {
+                (*ranks)[rank_groups.size() - 1 - i].customers_seconds = std::chrono::duration<double>(
+                    std::chrono::high_resolution_clock::now() - start).count();
             }
         }
     }
 };
 
-CPPSimulationEngine get_engine(std::string filename = "/home/anon/Desktop/caida.tsv") {
-    auto asGraph = std::make_unique<ASGraph>(readASGraph(filename));
+CPPSimulationEngine get_engine(std::string filename = "/home/anon/Desktop/caida.tsv", size_t num_threads = 1) {
+    auto asGraph = readASGraph(filename, num_threads);
     return CPPSimulationEngine(std::move(asGraph));
 }
 
+CPPSimulationEngine get_engine_from_snapshot(const std::string& filename) {
+    // Like get_engine, from a file written by write_graph_snapshot
+    return CPPSimulationEngine(readASGraphSnapshot(filename));
+}
+
 int main() {
     std::string filename = "/home/anon/Desktop/caida.tsv";
     std::string announcementsFilename = "/home/anon/Desktop/anns_1000_mod.tsv";
@@ -902,9 +4403,66 @@ int main() {
 namespace py = pybind11;
 #define PYBIND11_DETAILED_ERROR_MESSAGES
 
+// NumPy column passed to setup_from_arrays. Without forcecast, a C
+// contiguous array of this dtype is read in place and is never converted
+template <typename T>
+using NumpyColumn = py::array_t<T, py::array::c_style>;
+
+template <typename T>
+const T* numpy_column_data(const NumpyColumn<T>& column, size_t size, const std::string& name) {
+    if (column.ndim() != 1 || static_cast<size_t>(column.size()) != size) {
+        throw std::runtime_error(name + " must be a 1-d array with " + std::to_string(size) + " elements.");
+    }
+    return column.data();
+}
+
+template <typename T>
+const T* numpy_column_data(const std::optional<NumpyColumn<T>>& column, size_t size, const std::string& name) {
+    return column ? numpy_column_data(*column, size, name) : nullptr;
+}
+
+template <typename Results>
+py::capsule numpy_owner(std::shared_ptr<Results> results) {
+    // Keeps results alive for as long as any array viewing them exists
+    return py::capsule(new std::shared_ptr<Results>(std::move(results)), [](void* results) {
+        delete static_cast<std::shared_ptr<Results>*>(results);
+    });
+}
+
+template <typename T>
+py::array_t<T> numpy_view(const std::vector<T>& values, std::vector<py::ssize_t> shape, const py::capsule& owner) {
+    // An array over values' buffer, without copying it
+    return py::array_t<T>(std::move(shape), values.data(), owner);
+}
+
+py::dict rib_columns_to_numpy(std::shared_ptr<RIBColumns> columns) {
+    // Dict of RIBColumns NumPy arrays, with paths CSR flattened
+    py::capsule owner = numpy_owner(columns);
+    py::dict arrays;
+    arrays["as_offsets"] = numpy_view(columns->as_offsets, {static_cast<py::ssize_t>(columns->as_offsets.size())}, owner);
+    arrays["asns"] = numpy_view(columns->asns, {static_cast<py::ssize_t>(columns->asns.size())}, owner);
+    arrays["prefix_ids"] = numpy_view(columns->prefix_ids, {static_cast<py::ssize_t>(columns->prefix_ids.size())}, owner);
+    arrays["recv_relationships"] = numpy_view(columns->recv_relationships, {static_cast<py::ssize_t>(columns->recv_relationships.size())}, owner);
+    arrays["timestamps"] = numpy_view(columns->timestamps, {static_cast<py::ssize_t>(columns->timestamps.size())}, owner);
+    arrays["path_offsets"] = numpy_view(columns->path_offsets, {static_cast<py::ssize_t>(columns->path_offsets.size())}, owner);
+    arrays["path_asns"] = numpy_view(columns->path_asns, {static_cast<py::ssize_t>(columns->path_asns.size())}, owner);
+    return arrays;
+}
+
+void add_route_columns(py::dict& arrays, const RouteColumns& routes, std::vector<py::ssize_t> shape, const py::capsule& owner) {
+    arrays["next_hops"] = numpy_view(routes.next_hops, shape, owner);
+    arrays["origins"] = numpy_view(routes.origins, shape, owner);
+    arrays["path_lengths"] = numpy_view(routes.path_lengths, shape, owner);
+    arrays["recv_relationships"] = numpy_view(routes.recv_relationships, shape, owner);
+}
+
 PYBIND11_MODULE(python_example, m) {
     m.def("main", &main, "what is this desc for?");
-    m.def("get_engine", &get_engine, py::arg("filename") = "/home/anon/Desktop/caida.tsv");
+    m.def("get_engine", &get_engine, py::arg("filename") = "/home/anon/Desktop/caida.tsv",
+          py::arg("num_threads") = 1);
+    m.def("get_engine_from_snapshot", &get_engine_from_snapshot, py::arg("filename"));
+    m.def("read_announcements", &readAnnouncementBatch, py::arg("filename"), py::arg("num_threads") = 1,
+          py::call_guard<py::gil_scoped_release>());
     py::enum_<Relationships>(m, "Relationships")
         .value("PROVIDERS", Relationships::PROVIDERS)
         .value("PEERS", Relationships::PEERS)
@@ -913,6 +4471,23 @@ PYBIND11_MODULE(python_example, m) {
         .value("UNKNOWN", Relationships::UNKNOWN)
         .export_values();
 
+    py::enum_<LocalRIBBackend>(m, "LocalRIBBackend")
+        .value("MAP", LocalRIBBackend::MAP)
+        .value("SPARSE", LocalRIBBackend::SPARSE)
+        .value("DENSE", LocalRIBBackend::DENSE)
+        .value("AUTO", LocalRIBBackend::AUTO)
+        .export_values();
+
+    py::enum_<PropagationMode>(m, "PropagationMode")
+        .value("RANK_PARALLEL", PropagationMode::RANK_PARALLEL)
+        .value("PREFIX_SHARDED", PropagationMode::PREFIX_SHARDED)
+        .export_values();
+
+    py::enum_<RIBDumpFormat>(m, "RIBDumpFormat")
+        .value("TSV", RIBDumpFormat::TSV)
+        .value("BINARY", RIBDumpFormat::BINARY)
+        .export_values();
+
     py::class_<CPPSimulationEngine>(m, "CPPSimulationEngine")
         //.def(py::init<ASGraph&, int>(), py::arg("as_graph"), py::arg("ready_to_run_round") = -1)
         //.def("setup", &CPPSimulationEngine::setup,
@@ -927,9 +4502,11 @@ PYBIND11_MODULE(python_example, m) {
         //    engine.setup(announcements, base_policy_class_str, non_default_asn_cls_str_dict);
         //}, py::arg("announcements"), py::arg("base_policy_class_str") = "BGPSimplePolicy", py::arg("non_default_asn_cls_str_dict") = std::map<int, std::string>{})
 
-        .def("setup", [](CPPSimulationEngine& engine, const std::vector<std::shared_ptr<Announcement>>& announcements, const std::string& base_policy_class_str, const std::map<int, std::string>& non_default_asn_cls_str_dict) {
+        .def("setup", [](CPPSimulationEngine& engine, const std::vector<std::shared_ptr<Announcement>>& announcements, const std::string& base_policy_class_str, const std::map<int, std::string>& non_default_asn_cls_str_dict, LocalRIBBackend local_rib_backend) {
             // Debug: Print the number of announcements
-            std::cout << "Setting up engine with " << announcements.size() << " announcements." << std::endl;
+            if (engine.verbose) {
+                std::cout << "Setting up engine with " << announcements.size() << " announcements." << std::endl;
+            }
 
             // Check for null pointers
             for (const auto& ann : announcements) {
@@ -939,10 +4516,203 @@ PYBIND11_MODULE(python_example, m) {
             }
 
             // Call the actual setup method
-            engine.setup(announcements, base_policy_class_str, non_default_asn_cls_str_dict);
-        }, py::arg("announcements"), py::arg("base_policy_class_str") = "BGPSimplePolicy", py::arg("non_default_asn_cls_str_dict") = std::map<int, std::string>{})
+            engine.setup(announcements, base_policy_class_str, non_default_asn_cls_str_dict, local_rib_backend);
+        }, py::arg("announcements"), py::arg("base_policy_class_str") = "BGPSimplePolicy", py::arg("non_default_asn_cls_str_dict") = std::map<int, std::string>{},
+           py::arg("local_rib_backend") = LocalRIBBackend::AUTO)
+        .def("setup", [](CPPSimulationEngine& engine, std::shared_ptr<AnnouncementBatch> announcements, const std::string& base_policy_class_str, const std::map<int, std::string>& non_default_asn_cls_str_dict, LocalRIBBackend local_rib_backend) {
+            engine.setup(std::move(announcements), base_policy_class_str, non_default_asn_cls_str_dict, local_rib_backend);
+        }, py::arg("announcements"), py::arg("base_policy_class_str") = "BGPSimplePolicy", py::arg("non_default_asn_cls_str_dict") = std::map<int, std::string>{},
+           py::arg("local_rib_backend") = LocalRIBBackend::AUTO)
+        .def("setup_from_arrays", [](CPPSimulationEngine& engine,
+                                     const std::vector<std::string>& prefixes,
+                                     const NumpyColumn<uint32_t>& prefix_ids,
+                                     const NumpyColumn<uint32_t>& as_path_offsets,
+                                     const NumpyColumn<int32_t>& as_path_asns,
+                                     const NumpyColumn<int32_t>& seed_asns,
+                                     const NumpyColumn<uint8_t>& recv_relationships,
+                                     const std::optional<NumpyColumn<int32_t>>& timestamps,
+                                     const std::optional<NumpyColumn<int8_t>>& roa_valid_lengths,
+                                     const std::optional<NumpyColumn<int32_t>>& roa_origins,
+                                     const std::optional<NumpyColumn<uint8_t>>& flags,
+                                     const std::string& base_policy_class_str,
+                                     const std::map<int, std::string>& non_default_asn_cls_str_dict,
+                                     LocalRIBBackend local_rib_backend) {
+            // Columns are read through the buffer protocol; see AnnouncementArrays
+            AnnouncementArrays arrays;
+            arrays.size = static_cast<size_t>(prefix_ids.size());
+            arrays.prefixes = &prefixes;
+            arrays.prefix_ids = numpy_column_data(prefix_ids, arrays.size, "prefix_ids");
+            arrays.path_offsets = numpy_column_data(as_path_offsets, arrays.size + 1, "as_path_offsets");
+            arrays.path_asns = as_path_asns.data();
+            if (as_path_asns.ndim() != 1 || static_cast<size_t>(as_path_asns.size()) < arrays.path_offsets[arrays.size]) {
+                throw std::runtime_error("as_path_asns must be a 1-d array covering as_path_offsets.");
+            }
+            arrays.seed_asns = numpy_column_data(seed_asns, arrays.size, "seed_asns");
+            arrays.recv_relationships = numpy_column_data(recv_relationships, arrays.size, "recv_relationships");
+            arrays.timestamps = numpy_column_data(timestamps, arrays.size, "timestamps");
+            arrays.roa_valid_lengths = numpy_column_data(roa_valid_lengths, arrays.size, "roa_valid_lengths");
+            arrays.roa_origins = numpy_column_data(roa_origins, arrays.size, "roa_origins");
+            arrays.flags = numpy_column_data(flags, arrays.size, "flags");
+            engine.setup_from_arrays(arrays, base_policy_class_str, non_default_asn_cls_str_dict, local_rib_backend);
+        }, py::arg("prefixes"), py::arg("prefix_ids"), py::arg("as_path_offsets"), py::arg("as_path_asns"),
+           py::arg("seed_asns"), py::arg("recv_relationships"), py::arg("timestamps") = py::none(),
+           py::arg("roa_valid_lengths") = py::none(), py::arg("roa_origins") = py::none(), py::arg("flags") = py::none(),
+           py::arg("base_policy_class_str") = "BGPSimplePolicy", py::arg("non_default_asn_cls_str_dict") = std::map<int, std::string>{},
+           py::arg("local_rib_backend") = LocalRIBBackend::AUTO)
+        .def("get_announcements_from_tsv", &CPPSimulationEngine::get_announcements_from_tsv, py::arg("path"))
         .def("run", &CPPSimulationEngine::run,
-             py::arg("propagation_round") = 0);
+             py::arg("propagation_round") = 0, py::arg("num_threads") = 1,
+             py::arg("propagation_mode") = PropagationMode::RANK_PARALLEL,
+             py::call_guard<py::gil_scoped_release>())
+        .def("get_local_rib", &CPPSimulationEngine::get_local_rib, py::arg("asn"))
+        .def("reset", &CPPSimulationEngine::reset)
+        .def("update_policies", &CPPSimulationEngine::update_policies, py::arg("asn_cls_str_dict"),
+             py::call_guard<py::gil_scoped_release>())
+        .def("withdraw", py::overload_cast<const std::vector<std::pair<int, std::string>>&>(&CPPSimulationEngine::withdraw),
+             py::arg("seeds"), py::call_guard<py::gil_scoped_release>())
+        .def("withdraw", [](CPPSimulationEngine& engine, const std::vector<std::shared_ptr<Announcement>>& announcements) {
+            // Announcements with the withdraw flag set, e.g. rows of an announcements TSV
+            auto batch = AnnouncementBatch::from_announcements(announcements);
+            py::gil_scoped_release release;
+            engine.withdraw(*batch);
+        }, py::arg("announcements"))
+        .def("withdraw", [](CPPSimulationEngine& engine, std::shared_ptr<AnnouncementBatch> announcements) {
+            py::gil_scoped_release release;
+            engine.withdraw(*announcements);
+        }, py::arg("announcements"))
+        .def("get_rib_matrices", [](CPPSimulationEngine& engine, const std::optional<std::vector<int>>& asns, size_t num_threads) {
+            // Dict of (ASes x prefixes) NumPy arrays over engine owned buffers
+            std::shared_ptr<RIBMatrices> matrices;
+            {
+                py::gil_scoped_release release;
+                matrices = engine.get_rib_matrices(asns, num_threads);
+            }
+            py::capsule owner = numpy_owner(matrices);
+            py::dict arrays;
+            arrays["asns"] = numpy_view(matrices->asns, {static_cast<py::ssize_t>(matrices->asns.size())}, owner);
+            add_route_columns(arrays, matrices->routes,
+                              {static_cast<py::ssize_t>(matrices->asns.size()), static_cast<py::ssize_t>(matrices->num_prefixes)}, owner);
+            return arrays;
+        }, py::arg("asns") = py::none(), py::arg("num_threads") = 1)
+        .def("get_rib_columns", [](CPPSimulationEngine& engine, const std::optional<std::vector<int>>& asns, size_t num_threads) {
+            std::shared_ptr<RIBColumns> columns;
+            {
+                py::gil_scoped_release release;
+                columns = engine.get_rib_columns(asns, num_threads);
+            }
+            return rib_columns_to_numpy(std::move(columns));
+        }, py::arg("asns") = py::none(), py::arg("num_threads") = 1)
+        .def("run_batch", [](CPPSimulationEngine& engine, const std::vector<Scenario>& scenarios, size_t num_threads,
+                             const std::optional<std::vector<int>>& asns) {
+            // List with the get_rib_columns() dict of each scenario
+            std::vector<std::shared_ptr<RIBColumns>> results;
+            {
+                py::gil_scoped_release release;
+                results = engine.run_batch(scenarios, num_threads, asns);
+            }
+            py::list rib_columns;
+            for (auto& columns : results) {
+                rib_columns.append(rib_columns_to_numpy(std::move(columns)));
+            }
+            return rib_columns;
+        }, py::arg("scenarios"), py::arg("num_threads") = 1, py::arg("asns") = py::none())
+        .def("lookup_routes", [](CPPSimulationEngine& engine, const NumpyColumn<int32_t>& asns, const NumpyColumn<uint32_t>& prefix_ids) {
+            // Dict of route arrays for the pairs (asns[i], prefix_ids[i])
+            size_t size = static_cast<size_t>(asns.size());
+            const int32_t* asns_data = numpy_column_data(asns, size, "asns");
+            const uint32_t* prefix_ids_data = numpy_column_data(prefix_ids, size, "prefix_ids");
+            std::shared_ptr<RouteColumns> routes;
+            {
+                py::gil_scoped_release release;
+                routes = std::make_shared<RouteColumns>(engine.lookup_routes(asns_data, prefix_ids_data, size));
+            }
+            py::dict arrays;
+            add_route_columns(arrays, *routes, {static_cast<py::ssize_t>(size)}, numpy_owner(routes));
+            return arrays;
+        }, py::arg("asns"), py::arg("prefix_ids"))
+        .def_readwrite("lazy_stubs", &CPPSimulationEngine::lazy_stubs)
+        .def_readwrite("verbose", &CPPSimulationEngine::verbose)
+        .def("memory_report", [](const CPPSimulationEngine& engine) {
+            // {category: {"bytes", "objects", "peak_bytes"}, ..., "total": {...},
+            //  "phases": {phase: {category: peak_bytes}}}
+            MemoryReport report = engine.memory_report();
+            py::dict result;
+            for (const auto& usage : report.usage) {
+                py::dict category;
+                category["bytes"] = usage.bytes;
+                category["objects"] = usage.objects;
+                category["peak_bytes"] = usage.peak_bytes;
+                result[py::str(usage.category)] = category;
+            }
+            result["phases"] = report.phase_peak_bytes;
+            return result;
+        })
+        .def("get_metrics", [](const CPPSimulationEngine& engine) {
+            // The last run's RunMetrics, with phase times under "phases"
+            const RunMetrics& metrics = engine.get_metrics();
+            py::dict result;
+            result["propagation_round"] = metrics.propagation_round;
+            result["num_threads"] = metrics.num_threads;
+            result["propagation_mode"] = metrics.propagation_mode;
+            result["seconds"] = metrics.seconds;
+            py::dict phases;
+            phases["providers"] = metrics.providers_seconds;
+            phases["peers"] = metrics.peers_seconds;
+            phases["customers"] = metrics.customers_seconds;
+            result["phases"] = phases;
+            py::list ranks;
+            for (const auto& rank_metrics : metrics.ranks) {
+                py::dict rank;
+                rank["num_ases"] = rank_metrics.num_ases;
+                rank["providers_seconds"] = rank_metrics.providers_seconds;
+                rank["customers_seconds"] = rank_metrics.customers_seconds;
+                ranks.append(rank);
+            }
+            result["ranks"] = ranks;
+            result["anns_received"] = metrics.anns_received;
+            result["anns_processed"] = metrics.anns_processed;
+            result["anns_accepted"] = metrics.anns_accepted;
+            result["anns_rejected_by_loop"] = metrics.anns_rejected_by_loop;
+            result["anns_rejected_by_filter"] = metrics.anns_rejected_by_filter;
+            result["recv_queue_peak"] = metrics.recv_queue_peak;
+            result["recv_queue_peak_asn"] = metrics.recv_queue_peak_asn;
+            return result;
+        })
+        .def("write_metrics", &CPPSimulationEngine::write_metrics, py::arg("path"))
+        .def("dump_local_ribs", &CPPSimulationEngine::dump_local_ribs,
+             py::arg("path"), py::arg("asns") = py::none(), py::arg("format") = RIBDumpFormat::TSV,
+             py::arg("num_threads") = 1, py::call_guard<py::gil_scoped_release>())
+        .def("write_graph_snapshot", [](const CPPSimulationEngine& engine, const std::string& filename) {
+            writeASGraphSnapshot(*engine.as_graph, filename);
+        }, py::arg("filename"))
+        .def("get_prefix_id", [](const CPPSimulationEngine& engine, const std::string& prefix) {
+            return engine.prefix_table.get_id(prefix);
+        }, py::arg("prefix"))
+        .def("get_prefix", [](const CPPSimulationEngine& engine, uint32_t prefix_id) {
+            return engine.prefix_table.get_prefix(prefix_id);
+        }, py::arg("prefix_id"));
+
+    py::class_<Scenario>(m, "Scenario")
+        .def(py::init([](std::shared_ptr<AnnouncementBatch> announcements, const std::string& base_policy_class_str,
+                         const std::map<int, std::string>& non_default_asn_cls_str_dict, LocalRIBBackend local_rib_backend) {
+            return Scenario{std::move(announcements), base_policy_class_str, non_default_asn_cls_str_dict, local_rib_backend};
+        }), py::arg("announcements"), py::arg("base_policy_class_str") = "BGPSimplePolicy",
+            py::arg("non_default_asn_cls_str_dict") = std::map<int, std::string>{},
+            py::arg("local_rib_backend") = LocalRIBBackend::AUTO)
+        .def_readwrite("base_policy_class_str", &Scenario::base_policy_class_str)
+        .def_readwrite("non_default_asn_cls_str_dict", &Scenario::non_default_asn_cls_str_dict)
+        .def_readwrite("local_rib_backend", &Scenario::local_rib_backend);
+
+    py::class_<AnnouncementBatch, std::shared_ptr<AnnouncementBatch>>(m, "AnnouncementBatch")
+        .def_static("from_announcements", &AnnouncementBatch::from_announcements, py::arg("announcements"))
+        .def("__len__", &AnnouncementBatch::size)
+        .def("__getitem__", [](const AnnouncementBatch& batch, size_t row) {
+            if (row >= batch.size()) {
+                throw py::index_error("Announcement batch index out of range.");
+            }
+            return batch.get(row);
+        }, py::arg("row"))
+        .def("to_list", &AnnouncementBatch::to_announcements);
 
     py::class_<Announcement, std::shared_ptr<Announcement>>(m, "Announcement")
         .def(py::init<const std::string&, const std::vector<int>&, int,
@@ -950,7 +4720,10 @@ PYBIND11_MODULE(python_example, m) {
                       const std::optional<int>&, Relationships, bool, bool,
                       const std::vector<std::string>&>())
         .def_readonly("prefix", &Announcement::prefix)
-        .def_readonly("as_path", &Announcement::as_path)
+        .def_readonly("prefix_id", &Announcement::prefix_id)
+        .def_property_readonly("as_path", [](const Announcement& ann) {
+            return ann.as_path.to_vector();
+        })
         .def_readonly("timestamp", &Announcement::timestamp)
         .def_readonly("seed_asn", &Announcement::seed_asn)
         .def_readonly("roa_valid_length", &Announcement::roa_valid_length)